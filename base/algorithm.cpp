@@ -10,7 +10,72 @@
 
 #include <cfenv>
 
+#if defined __SSE2__ || defined _M_X64 \
+	|| (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define BASE_ALGORITHM_SSE2
+#include <emmintrin.h>
+#elif defined __aarch64__ || defined _M_ARM64
+#define BASE_ALGORITHM_NEON
+#include <arm_neon.h>
+#endif
+
 namespace base {
+namespace {
+
+constexpr auto kBlockSize = 8;
+
+// All the chars are printable ASCII, other than the space.
+[[nodiscard]] inline bool RegularBlock(const QChar *from) {
+#ifdef BASE_ALGORITHM_SSE2
+	const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+	const auto regular = _mm_and_si128(
+		_mm_cmpgt_epi16(block, _mm_set1_epi16(' ')),
+		_mm_cmplt_epi16(block, _mm_set1_epi16(0x80)));
+	return (_mm_movemask_epi8(regular) == 0xFFFF);
+#elif defined BASE_ALGORITHM_NEON // BASE_ALGORITHM_SSE2
+	const auto block = vld1q_u16(reinterpret_cast<const uint16_t*>(from));
+	const auto regular = vandq_u16(
+		vcgtq_u16(block, vdupq_n_u16(' ')),
+		vcltq_u16(block, vdupq_n_u16(0x80)));
+	return (vminvq_u16(regular) == 0xFFFF);
+#else // BASE_ALGORITHM_SSE2 || BASE_ALGORITHM_NEON
+	return std::all_of(from, from + kBlockSize, [](QChar ch) {
+		return (ch.unicode() > ' ' && ch.unicode() < 0x80);
+	});
+#endif // BASE_ALGORITHM_SSE2 || BASE_ALGORITHM_NEON
+}
+
+// Control chars are replaced by spaces, so they count as ones.
+[[nodiscard]] inline bool IsSpaceOrControl(QChar ch) {
+	return (ch.unicode() <= ' ') || (ch.unicode() >= 0x80 && ch.isSpace());
+}
+
+// Returns the first index from which the text needs changes.
+[[nodiscard]] qsizetype FindNotSimplified(
+		const QChar *data,
+		qsizetype size) {
+	auto previousSpace = true; // No leading spaces.
+	for (auto i = qsizetype(0); i != size;) {
+		if (size - i >= kBlockSize && RegularBlock(data + i)) {
+			previousSpace = false;
+			i += kBlockSize;
+			continue;
+		}
+		const auto ch = data[i];
+		if (IsSpaceOrControl(ch)) {
+			if (previousSpace || ch.unicode() != ' ' || i + 1 == size) {
+				return i;
+			}
+			previousSpace = true;
+		} else {
+			previousSpace = false;
+		}
+		++i;
+	}
+	return size;
+}
+
+} // namespace
 
 [[nodiscard]] double SafeRound(double value) {
 	Expects(!std::isnan(value));
@@ -33,12 +98,40 @@ namespace base {
 }
 
 QString CleanAndSimplify(QString text) {
-	for (auto &ch : text) {
-		if (ch.unicode() < 32) {
-			ch = QChar(' ');
+	const auto size = text.size();
+	const auto from = FindNotSimplified(text.constData(), size);
+	if (from == size) {
+		return text;
+	}
+
+	// Everything before is simplified already, the rest is compacted
+	// in place, so there is at most one copy if the text was shared.
+	const auto data = text.data();
+	auto to = data + from;
+	auto space = (from > 0) && (data[from - 1].unicode() == ' ');
+	if (space) {
+		--to;
+	}
+	for (auto i = from; i != size;) {
+		if (!space && size - i >= kBlockSize && RegularBlock(data + i)) {
+			std::copy(data + i, data + i + kBlockSize, to);
+			to += kBlockSize;
+			i += kBlockSize;
+			continue;
+		}
+		const auto ch = data[i++];
+		if (IsSpaceOrControl(ch)) {
+			space = true;
+		} else {
+			if (space && to != data) {
+				*to++ = QChar(' ');
+			}
+			space = false;
+			*to++ = ch;
 		}
 	}
-	return text.simplified();
+	text.resize(to - data);
+	return text;
 }
 
 } // namespace base
@@ -6,6 +6,8 @@
 //
 #pragma once
 
+#include "base/utf8.h"
+
 #include <QtCore/QLatin1String>
 #include <QtCore/QString>
 #include <memory>
@@ -118,11 +120,11 @@ inline QString FromUtf8Safe(const char *string, int size = -1) {
 	} else if (size < 0) {
 		size = strlen(string);
 	}
-	const auto result = QString::fromUtf8(string, size);
-	const auto back = result.toUtf8();
-	return (back.size() != size || memcmp(back.constData(), string, size))
-		? QString::fromLocal8Bit(string, size)
-		: result;
+	// QString::fromUtf8() skips the BOM, so it never was round-tripped.
+	const auto bom = (size >= 3) && !memcmp(string, "\xEF\xBB\xBF", 3);
+	return (!bom && ValidateUtf8({ string, size_t(size) }).valid)
+		? QString::fromUtf8(string, size)
+		: QString::fromLocal8Bit(string, size);
 }
 
 inline QString FromUtf8Safe(const QByteArray &string) {
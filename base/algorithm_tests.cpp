@@ -6,8 +6,52 @@
 //
 #include <catch.hpp>
 
+#include "base/algorithm.h"
 #include "base/index_based_iterator.h"
 
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+
+[[nodiscard]] QString SimpleCleanAndSimplify(QString text) {
+	for (auto &ch : text) {
+		if (ch.unicode() < 32) {
+			ch = QChar::Space;
+		}
+	}
+	return text.simplified();
+}
+
+[[nodiscard]] QString RandomText(std::mt19937 &generator) {
+	const QString pieces[] = {
+		u"a"_q,
+		u"Z"_q,
+		u" "_q,
+		u"  "_q,
+		u"\t"_q,
+		u"\n"_q,
+		QString(QChar(1)),
+		QString(QChar(31)),
+		QString(QChar(0x7F)),
+		QString(QChar(0x85)),
+		QString(QChar(0xA0)),
+		QString(QChar(0x2003)),
+		QString(QChar(0x3000)),
+		u"\u0434\u0430"_q,
+		u"LongAsciiRunWithoutSpaces"_q,
+	};
+	auto result = QString();
+	const auto count = generator() % 24;
+	for (auto i = 0; i != int(count); ++i) {
+		result += pieces[generator() % std::size(pieces)];
+	}
+	return result;
+}
+
+} // namespace
+
 TEST_CASE("index_based_iterator tests", "[base::algorithm]") {
 	auto v = std::vector<int>();
 
@@ -46,4 +90,49 @@ TEST_CASE("index_based_iterator tests", "[base::algorithm]") {
 		auto expected = std::vector<int> { 5 };
 		REQUIRE(v == expected);
 	}
-}
\ No newline at end of file
+}
+
+TEST_CASE("CleanAndSimplify matches simplified", "[base::algorithm]") {
+	REQUIRE(base::CleanAndSimplify(QString()).isEmpty());
+	REQUIRE(base::CleanAndSimplify(u" \t\n"_q).isEmpty());
+	REQUIRE(base::CleanAndSimplify(u"simple text"_q) == u"simple text"_q);
+	REQUIRE(base::CleanAndSimplify(u"  Mac\x01\tBook\tPro  "_q)
+		== u"Mac Book Pro"_q);
+
+	auto generator = std::mt19937(1);
+	for (auto i = 0; i != 100000; ++i) {
+		const auto text = RandomText(generator);
+		REQUIRE(base::CleanAndSimplify(text) == SimpleCleanAndSimplify(text));
+	}
+}
+
+TEST_CASE("CleanAndSimplify throughput", "[.][base::algorithm][benchmark]") {
+	using Clock = std::chrono::steady_clock;
+	for (const auto length : { 16, 4096 }) {
+		auto text = QString();
+		while (text.size() < length) {
+			text += u"Some  device\x01model name, "_q;
+		}
+		const auto count = 4 * 1024 * 1024 / length;
+		auto checksum = 0;
+		const auto simpleStart = Clock::now();
+		for (auto i = 0; i != count; ++i) {
+			checksum += SimpleCleanAndSimplify(text).size();
+		}
+		const auto start = Clock::now();
+		for (auto i = 0; i != count; ++i) {
+			checksum += base::CleanAndSimplify(text).size();
+		}
+		const auto finish = Clock::now();
+		const auto ns = [&](auto duration) {
+			return std::chrono::duration<double, std::nano>(duration).count()
+				/ count;
+		};
+		std::cout
+			<< length << " chars: "
+			<< "replace and simplified: " << ns(start - simpleStart) << " ns, "
+			<< "CleanAndSimplify: " << ns(finish - start) << " ns "
+			<< "(" << (checksum & 1) << ")"
+			<< std::endl;
+	}
+}
@@ -0,0 +1,83 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/atomic_file_writer.h"
+
+namespace base {
+
+AtomicFileWriter::AtomicFileWriter(
+	const QString &path,
+	AtomicFileWriterOptions options)
+: _path(path)
+, _options(options)
+, _file(details::AtomicTemporaryFile::Create(path, options.preallocate)) {
+	if (!_file) {
+		_failed = true;
+	} else if (_options.bufferSize > 0) {
+		_buffer.reserve(_options.bufferSize);
+	}
+}
+
+AtomicFileWriter::~AtomicFileWriter() = default;
+
+bool AtomicFileWriter::failed() const {
+	return _failed;
+}
+
+bool AtomicFileWriter::write(bytes::const_span data) {
+	if (_failed) {
+		return false;
+	}
+	const auto size = int64(data.size());
+	_written += size;
+	if (size_type(_buffer.size()) + size <= _options.bufferSize) {
+		_buffer.insert(end(_buffer), data.begin(), data.end());
+		return true;
+	} else if (!flush()) {
+		return false;
+	} else if (size < _options.bufferSize) {
+		_buffer.insert(end(_buffer), data.begin(), data.end());
+		return true;
+	} else if (!_file->write(data)) {
+		_failed = true;
+		return false;
+	}
+	return true;
+}
+
+bool AtomicFileWriter::write(const QByteArray &data) {
+	return write(bytes::make_span(data));
+}
+
+bool AtomicFileWriter::flush() {
+	if (_buffer.empty()) {
+		return true;
+	} else if (!_file->write(_buffer)) {
+		_failed = true;
+		return false;
+	}
+	_buffer.clear();
+	return true;
+}
+
+bool AtomicFileWriter::commit() {
+	if (_failed || !flush()) {
+		cancel();
+		return false;
+	}
+	const auto file = std::move(_file);
+	_failed = true;
+	return file->finish(_written, _options.durable)
+		&& file->replace(_path, _options.durable);
+}
+
+void AtomicFileWriter::cancel() {
+	_file = nullptr;
+	_buffer.clear();
+	_failed = true;
+}
+
+} // namespace base
@@ -0,0 +1,83 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+#include "base/basic_types.h"
+#include "base/bytes.h"
+
+namespace base {
+namespace details {
+
+// Implemented for each platform, the file is removed unless replaced.
+class AtomicTemporaryFile final {
+public:
+	[[nodiscard]] static std::unique_ptr<AtomicTemporaryFile> Create(
+		const QString &path,
+		int64 preallocate);
+
+	AtomicTemporaryFile(quintptr handle, QString path, int64 preallocated);
+	~AtomicTemporaryFile();
+
+	[[nodiscard]] bool write(bytes::const_span data);
+
+	// Trims the preallocated tail, syncs the data if durable and closes.
+	[[nodiscard]] bool finish(int64 size, bool durable);
+
+	// Syncs the directory if durable.
+	[[nodiscard]] bool replace(const QString &path, bool durable);
+
+private:
+	bool close();
+
+	quintptr _handle = 0;
+	QString _path;
+	int64 _preallocated = 0;
+	bool _closed = false;
+	bool _replaced = false;
+
+};
+
+} // namespace details
+
+struct AtomicFileWriterOptions {
+	int64 preallocate = 0; // Expected size, if known.
+	int bufferSize = 1024 * 1024;
+	bool durable = true; // Survive a power loss, not only a crash.
+};
+
+// Streams to a temporary file near the target one and replaces the
+// target with it in commit(), so readers see either the old content
+// or the new one. The temporary file is removed if not committed.
+class AtomicFileWriter final {
+public:
+	explicit AtomicFileWriter(
+		const QString &path,
+		AtomicFileWriterOptions options = {});
+	AtomicFileWriter(const AtomicFileWriter &other) = delete;
+	AtomicFileWriter &operator=(const AtomicFileWriter &other) = delete;
+	~AtomicFileWriter();
+
+	[[nodiscard]] bool failed() const;
+
+	bool write(bytes::const_span data);
+	bool write(const QByteArray &data);
+	[[nodiscard]] bool commit();
+	void cancel();
+
+private:
+	bool flush();
+
+	QString _path;
+	AtomicFileWriterOptions _options;
+	std::unique_ptr<details::AtomicTemporaryFile> _file;
+	bytes::vector _buffer;
+	int64 _written = 0;
+	bool _failed = false;
+
+};
+
+} // namespace base
@@ -0,0 +1,150 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/atomic_file_writer.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace base::details {
+namespace {
+
+[[nodiscard]] int Descriptor(quintptr handle) {
+	return int(handle);
+}
+
+[[nodiscard]] bool SyncData(int descriptor) {
+#ifdef Q_OS_MAC
+	return !fsync(descriptor);
+#else // Q_OS_MAC
+	// The size is already right if preallocated, so skip the metadata.
+	return !fdatasync(descriptor);
+#endif // Q_OS_MAC
+}
+
+// The rename itself is durable only after the directory is synced.
+[[nodiscard]] bool SyncDirectory(const QString &path) {
+	const auto directory = QFile::encodeName(QFileInfo(path).absolutePath());
+	const auto descriptor = open(
+		directory.constData(),
+		O_RDONLY | O_CLOEXEC);
+	if (descriptor < 0) {
+		return false;
+	}
+	const auto result = !fsync(descriptor);
+	::close(descriptor);
+	return result;
+}
+
+} // namespace
+
+std::unique_ptr<AtomicTemporaryFile> AtomicTemporaryFile::Create(
+		const QString &path,
+		int64 preallocate) {
+	const auto target = QFile::encodeName(path);
+	auto name = target + ".XXXXXX";
+	const auto descriptor = mkstemp(name.data());
+	if (descriptor < 0) {
+		return nullptr;
+	}
+	fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+
+	// mkstemp() gives an owner-only mode, keep the one of the target.
+	struct stat info;
+	if (!stat(target.constData(), &info)) {
+		fchmod(descriptor, info.st_mode & 07777);
+	}
+
+	// Not supported on all file systems, it is only a hint anyway.
+	auto preallocated = int64(0);
+#ifdef Q_OS_LINUX
+	if (preallocate > 0 && !fallocate(descriptor, 0, 0, preallocate)) {
+		preallocated = preallocate;
+	}
+#endif // Q_OS_LINUX
+
+	return std::make_unique<AtomicTemporaryFile>(
+		quintptr(descriptor),
+		QFile::decodeName(name),
+		preallocated);
+}
+
+AtomicTemporaryFile::AtomicTemporaryFile(
+	quintptr handle,
+	QString path,
+	int64 preallocated)
+: _handle(handle)
+, _path(std::move(path))
+, _preallocated(preallocated) {
+}
+
+AtomicTemporaryFile::~AtomicTemporaryFile() {
+	close();
+	if (!_replaced) {
+		unlink(QFile::encodeName(_path).constData());
+	}
+}
+
+bool AtomicTemporaryFile::close() {
+	if (_closed) {
+		return true;
+	}
+	_closed = true;
+	return !::close(Descriptor(_handle));
+}
+
+bool AtomicTemporaryFile::write(bytes::const_span data) {
+	Expects(!_closed);
+
+	auto from = reinterpret_cast<const char*>(data.data());
+	auto left = std::size_t(data.size());
+	while (left > 0) {
+		const auto written = ::write(Descriptor(_handle), from, left);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		from += written;
+		left -= written;
+	}
+	return true;
+}
+
+bool AtomicTemporaryFile::finish(int64 size, bool durable) {
+	Expects(!_closed);
+
+	const auto descriptor = Descriptor(_handle);
+	if (_preallocated > size && ftruncate(descriptor, size)) {
+		return false;
+	} else if (durable && !SyncData(descriptor)) {
+		return false;
+	}
+	return close();
+}
+
+bool AtomicTemporaryFile::replace(const QString &path, bool durable) {
+	Expects(_closed);
+
+	const auto from = QFile::encodeName(_path);
+	const auto to = QFile::encodeName(path);
+	if (rename(from.constData(), to.constData())) {
+		return false;
+	}
+	_replaced = true;
+	return !durable || SyncDirectory(path);
+}
+
+} // namespace base::details
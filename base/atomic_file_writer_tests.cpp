@@ -0,0 +1,148 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/atomic_file_writer.h"
+#include "base/platform/base_platform_file_utilities.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+
+#include <chrono>
+#include <iostream>
+
+namespace {
+
+[[nodiscard]] QByteArray ReadAll(const QString &path) {
+	auto file = QFile(path);
+	return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+[[nodiscard]] QByteArray Pattern(int size) {
+	auto result = QByteArray(size, Qt::Uninitialized);
+	for (auto i = 0; i != size; ++i) {
+		result[i] = char(i * 7 + (i >> 8));
+	}
+	return result;
+}
+
+[[nodiscard]] bool WriteWithQFile(const QString &path, const QByteArray &data) {
+	const auto temporary = path + u".tmp"_q;
+	auto file = QFile(temporary);
+	if (!file.open(QIODevice::WriteOnly)
+		|| file.write(data) != data.size()) {
+		return false;
+	}
+	base::Platform::FlushFileData(file);
+	file.close();
+	return base::Platform::RenameWithOverwrite(temporary, path);
+}
+
+[[nodiscard]] bool WriteAtomic(
+		const QString &path,
+		const QByteArray &data,
+		int chunk,
+		base::AtomicFileWriterOptions options) {
+	auto writer = base::AtomicFileWriter(path, options);
+	for (auto i = 0; i < data.size(); i += chunk) {
+		writer.write(data.mid(i, chunk));
+	}
+	return writer.commit();
+}
+
+} // namespace
+
+TEST_CASE("atomic file writer", "[atomic_file_writer]") {
+	const auto directory = QTemporaryDir();
+	REQUIRE(directory.isValid());
+	const auto path = directory.filePath(u"settings"_q);
+	const auto data = Pattern(3 * 1024 * 1024 + 17);
+
+	SECTION("writes small and large chunks") {
+		for (const auto chunk : { 1, 100, 64 * 1024, 2 * 1024 * 1024 }) {
+			const auto part = data.mid(0, (chunk == 1) ? 4096 : data.size());
+			REQUIRE(WriteAtomic(path, part, chunk, {}));
+			REQUIRE(ReadAll(path) == part);
+		}
+	}
+
+	SECTION("trims the preallocated space") {
+		REQUIRE(WriteAtomic(path, data.mid(0, 1000), 1000, {
+			.preallocate = 1024 * 1024,
+		}));
+		REQUIRE(ReadAll(path) == data.mid(0, 1000));
+		REQUIRE(QFile(path).size() == 1000);
+	}
+
+	SECTION("keeps the old content until committed") {
+		REQUIRE(WriteAtomic(path, data.mid(0, 10), 10, {}));
+		{
+			auto writer = base::AtomicFileWriter(path);
+			writer.write(data.mid(10, 100));
+			REQUIRE(ReadAll(path) == data.mid(0, 10));
+		}
+		REQUIRE(ReadAll(path) == data.mid(0, 10));
+		{
+			auto writer = base::AtomicFileWriter(path, { .durable = false });
+			writer.write(data.mid(10, 100));
+			writer.cancel();
+			REQUIRE(writer.failed());
+			REQUIRE(!writer.commit());
+		}
+		REQUIRE(ReadAll(path) == data.mid(0, 10));
+		REQUIRE(QDir(directory.path()).entryList(QDir::Files)
+			== QStringList{ u"settings"_q });
+	}
+
+	SECTION("fails in a missing directory") {
+		auto writer = base::AtomicFileWriter(
+			directory.filePath(u"missing/settings"_q));
+		REQUIRE(writer.failed());
+		REQUIRE(!writer.write(data.mid(0, 10)));
+		REQUIRE(!writer.commit());
+	}
+}
+
+TEST_CASE("atomic file writer speed", "[.][atomic_file_writer][benchmark]") {
+	using Clock = std::chrono::steady_clock;
+	const auto directory = QTemporaryDir();
+	REQUIRE(directory.isValid());
+	const auto path = directory.filePath(u"settings"_q);
+	for (const auto size : { 4 * 1024, 1024 * 1024, 64 * 1024 * 1024 }) {
+		const auto data = Pattern(size);
+		const auto count = std::max(16 * 1024 * 1024 / size, 2);
+		const auto measure = [&](auto &&write) {
+			const auto start = Clock::now();
+			for (auto i = 0; i != count; ++i) {
+				REQUIRE(write());
+			}
+			return std::chrono::duration<double, std::micro>(
+				Clock::now() - start).count() / count;
+		};
+		const auto qfile = measure([&] {
+			return WriteWithQFile(path, data);
+		});
+		const auto durable = measure([&] {
+			return WriteAtomic(path, data, 4096, {
+				.preallocate = size,
+			});
+		});
+		const auto fast = measure([&] {
+			return WriteAtomic(path, data, 4096, {
+				.preallocate = size,
+				.durable = false,
+			});
+		});
+		std::cout
+			<< size << " bytes: "
+			<< "QFile + FlushFileData: " << qfile << " us, "
+			<< "AtomicFileWriter: " << durable << " us, "
+			<< "not durable: " << fast << " us"
+			<< std::endl;
+	}
+}
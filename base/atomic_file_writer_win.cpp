@@ -0,0 +1,139 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/atomic_file_writer.h"
+
+#include "base/random.h"
+
+#include <QtCore/QDir>
+
+#include <windows.h>
+
+namespace base::details {
+namespace {
+
+constexpr auto kCreateAttempts = 16;
+constexpr auto kMaxWriteChunk = DWORD(1024 * 1024 * 1024);
+
+[[nodiscard]] HANDLE Handle(quintptr handle) {
+	return reinterpret_cast<HANDLE>(handle);
+}
+
+[[nodiscard]] std::wstring NativePath(const QString &path) {
+	return QDir::toNativeSeparators(path).toStdWString();
+}
+
+} // namespace
+
+std::unique_ptr<AtomicTemporaryFile> AtomicTemporaryFile::Create(
+		const QString &path,
+		int64 preallocate) {
+	for (auto i = 0; i != kCreateAttempts; ++i) {
+		const auto temporary = path
+			+ '.'
+			+ QString::number(RandomValue<uint32>(), 16);
+		const auto handle = CreateFileW(
+			NativePath(temporary).c_str(),
+			GENERIC_WRITE,
+			0,
+			nullptr,
+			CREATE_NEW,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			if (GetLastError() == ERROR_FILE_EXISTS) {
+				continue;
+			}
+			return nullptr;
+		}
+
+		// Allocation beyond the end of file is released on close,
+		// so there is nothing to trim later.
+		if (preallocate > 0) {
+			auto info = FILE_ALLOCATION_INFO();
+			info.AllocationSize.QuadPart = preallocate;
+			SetFileInformationByHandle(
+				handle,
+				FileAllocationInfo,
+				&info,
+				sizeof(info));
+		}
+		return std::make_unique<AtomicTemporaryFile>(
+			quintptr(handle),
+			temporary,
+			int64(0));
+	}
+	return nullptr;
+}
+
+AtomicTemporaryFile::AtomicTemporaryFile(
+	quintptr handle,
+	QString path,
+	int64 preallocated)
+: _handle(handle)
+, _path(std::move(path))
+, _preallocated(preallocated) {
+}
+
+AtomicTemporaryFile::~AtomicTemporaryFile() {
+	close();
+	if (!_replaced) {
+		DeleteFileW(NativePath(_path).c_str());
+	}
+}
+
+bool AtomicTemporaryFile::close() {
+	if (_closed) {
+		return true;
+	}
+	_closed = true;
+	return CloseHandle(Handle(_handle));
+}
+
+bool AtomicTemporaryFile::write(bytes::const_span data) {
+	Expects(!_closed);
+
+	auto from = data.data();
+	auto left = int64(data.size());
+	while (left > 0) {
+		const auto chunk = DWORD(std::min(left, int64(kMaxWriteChunk)));
+		auto written = DWORD(0);
+		if (!WriteFile(Handle(_handle), from, chunk, &written, nullptr)) {
+			return false;
+		}
+		from += written;
+		left -= written;
+	}
+	return true;
+}
+
+bool AtomicTemporaryFile::finish(
+		[[maybe_unused]] int64 size,
+		bool durable) {
+	Expects(!_closed);
+
+	if (durable && !FlushFileBuffers(Handle(_handle))) {
+		return false;
+	}
+	return close();
+}
+
+bool AtomicTemporaryFile::replace(const QString &path, bool durable) {
+	Expects(_closed);
+
+	const auto flags = MOVEFILE_REPLACE_EXISTING
+		| (durable ? MOVEFILE_WRITE_THROUGH : 0);
+	if (!MoveFileExW(
+			NativePath(_path).c_str(),
+			NativePath(path).c_str(),
+			flags)) {
+		return false;
+	}
+	_replaced = true;
+	return true;
+}
+
+} // namespace base::details
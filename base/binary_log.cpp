@@ -0,0 +1,504 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/binary_log.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+
+#include <mutex>
+
+namespace base::binary_log {
+namespace details {
+
+std::atomic<bool> Started/* = false*/;
+
+} // namespace details
+namespace {
+
+// File: [kMagic][varint kVersion][varint start ms since epoch] blocks.
+// Block: [kind byte][varint size][payload].
+constexpr auto kMagic = std::string_view("TDBL");
+constexpr auto kVersion = uint32(1);
+constexpr auto kFlushSize = std::size_t(64 * 1024);
+
+enum class Block : uchar {
+	Format = 1, // [varint id][varint line][string file][string format]
+	Records = 2, // [varint id][varint time][varint thread][count] args...
+};
+
+enum class Argument : uchar {
+	Int, // [zigzag varint]
+	UInt, // [varint]
+	Double, // [8 bytes]
+	Utf8, // [varint size][bytes]
+	Utf16, // [varint length][2 * length bytes]
+};
+
+struct Format {
+	QByteArray format;
+	QByteArray file;
+	int line = 0;
+};
+
+void WriteVarint(bytes::vector &to, uint64 value) {
+	while (value >= 0x80) {
+		to.push_back(bytes::type(uchar(value) | 0x80));
+		value >>= 7;
+	}
+	to.push_back(bytes::type(uchar(value)));
+}
+
+void WriteRaw(bytes::vector &to, const void *data, std::size_t size) {
+	const auto from = static_cast<const bytes::type*>(data);
+	to.insert(end(to), from, from + size);
+}
+
+void WriteString(bytes::vector &to, std::string_view value) {
+	WriteVarint(to, value.size());
+	WriteRaw(to, value.data(), value.size());
+}
+
+class Reader final {
+public:
+	explicit Reader(bytes::const_span data) : _data(data) {
+	}
+
+	[[nodiscard]] bool failed() const {
+		return _failed;
+	}
+	[[nodiscard]] bool atEnd() const {
+		return _data.empty();
+	}
+	void fail() {
+		_failed = true;
+	}
+
+	[[nodiscard]] uint64 varint() {
+		auto result = uint64();
+		for (auto shift = 0; shift < 64; shift += 7) {
+			const auto byte = uchar(take(1)[0]);
+			if (_failed) {
+				return 0;
+			}
+			result |= uint64(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return result;
+			}
+		}
+		_failed = true;
+		return 0;
+	}
+	[[nodiscard]] bytes::const_span take(std::size_t size) {
+		static const auto kZero = bytes::type();
+		if (_failed || size > _data.size()) {
+			_failed = true;
+			return { &kZero, 1 };
+		}
+		const auto result = _data.subspan(0, size);
+		_data = _data.subspan(size);
+		return result;
+	}
+	[[nodiscard]] QByteArray string() {
+		const auto size = varint();
+		const auto data = take(size);
+		return _failed
+			? QByteArray()
+			: QByteArray(reinterpret_cast<const char*>(data.data()), size);
+	}
+
+private:
+	bytes::const_span _data;
+	bool _failed = false;
+
+};
+
+} // namespace
+
+namespace details {
+
+class Buffer final {
+public:
+	explicit Buffer(uint32 thread) : _thread(thread) {
+		_data.reserve(kFlushSize + kFlushSize / 4);
+	}
+
+	std::mutex mutex;
+
+	[[nodiscard]] uint32 thread() const {
+		return _thread;
+	}
+	[[nodiscard]] bytes::vector &data() {
+		return _data;
+	}
+
+private:
+	const uint32 _thread = 0;
+	bytes::vector _data;
+
+};
+
+} // namespace details
+
+namespace {
+
+using details::Buffer;
+
+class Log final {
+public:
+	bool start(const QString &path);
+	void stop();
+	void flush();
+
+	[[nodiscard]] FormatId registerFormat(
+		const char *format,
+		const char *file,
+		int line);
+	[[nodiscard]] crl::time started() const;
+
+	[[nodiscard]] not_null<Buffer*> buffer();
+	void write(not_null<Buffer*> buffer);
+
+private:
+	struct BufferHolder {
+		~BufferHolder();
+
+		std::shared_ptr<Buffer> buffer;
+	};
+
+	void writeLocked(not_null<Buffer*> buffer);
+	void remove(not_null<Buffer*> buffer);
+
+	static thread_local BufferHolder CurrentBuffer;
+
+	std::mutex _mutex;
+	QFile _file;
+	std::vector<Format> _formats;
+	std::size_t _formatsWritten = 0;
+	std::vector<std::shared_ptr<Buffer>> _buffers;
+	uint32 _threads = 0;
+	crl::time _started = 0;
+	bytes::vector _header;
+
+};
+
+Log GlobalLog;
+thread_local Log::BufferHolder Log::CurrentBuffer;
+
+Log::BufferHolder::~BufferHolder() {
+	if (buffer) {
+		GlobalLog.remove(buffer.get());
+	}
+}
+
+bool Log::start(const QString &path) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_file.isOpen()) {
+		return false;
+	}
+	_file.setFileName(path);
+	if (!_file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	_started = crl::now();
+	const auto epoch = QDateTime::currentMSecsSinceEpoch();
+
+	auto header = bytes::vector();
+	WriteRaw(header, kMagic.data(), kMagic.size());
+	WriteVarint(header, kVersion);
+	WriteVarint(header, uint64(epoch));
+	_file.write(reinterpret_cast<const char*>(header.data()), header.size());
+	_formatsWritten = 0;
+	details::Started.store(true, std::memory_order_release);
+	return true;
+}
+
+void Log::stop() {
+	details::Started.store(false, std::memory_order_release);
+	flush();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_file.close();
+}
+
+void Log::flush() {
+	auto buffers = std::vector<std::shared_ptr<Buffer>>();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		buffers = _buffers;
+	}
+	for (const auto &buffer : buffers) {
+		std::lock_guard<std::mutex> lock(buffer->mutex);
+		write(buffer.get());
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	_file.flush();
+}
+
+FormatId Log::registerFormat(
+		const char *format,
+		const char *file,
+		int line) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_formats.push_back({
+		.format = QByteArray(format),
+		.file = QByteArray(file),
+		.line = line,
+	});
+	return FormatId(_formats.size() - 1);
+}
+
+crl::time Log::started() const {
+	return _started;
+}
+
+not_null<Buffer*> Log::buffer() {
+	auto &holder = CurrentBuffer;
+	if (!holder.buffer) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		holder.buffer = std::make_shared<Buffer>(++_threads);
+		_buffers.push_back(holder.buffer);
+	}
+	return holder.buffer.get();
+}
+
+void Log::write(not_null<Buffer*> buffer) {
+	if (buffer->data().empty()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	writeLocked(buffer);
+}
+
+void Log::writeLocked(not_null<Buffer*> buffer) {
+	auto &data = buffer->data();
+	if (!_file.isOpen()) {
+		data.clear();
+		return;
+	}
+	_header.clear();
+	for (; _formatsWritten != _formats.size(); ++_formatsWritten) {
+		const auto &format = _formats[_formatsWritten];
+		auto payload = bytes::vector();
+		WriteVarint(payload, _formatsWritten);
+		WriteVarint(payload, format.line);
+		WriteString(payload, { format.file.constData(), size_t(format.file.size()) });
+		WriteString(payload, { format.format.constData(), size_t(format.format.size()) });
+		_header.push_back(bytes::type(Block::Format));
+		WriteVarint(_header, payload.size());
+		WriteRaw(_header, payload.data(), payload.size());
+	}
+	_header.push_back(bytes::type(Block::Records));
+	WriteVarint(_header, data.size());
+	_file.write(reinterpret_cast<const char*>(_header.data()), _header.size());
+	_file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	data.clear();
+}
+
+void Log::remove(not_null<Buffer*> buffer) {
+	{
+		std::lock_guard<std::mutex> lock(buffer->mutex);
+		write(buffer);
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	_buffers.erase(ranges::remove_if(_buffers, [&](const auto &entry) {
+		return (entry.get() == buffer);
+	}), end(_buffers));
+}
+
+[[nodiscard]] QString ArgumentText(Reader &reader) {
+	const auto type = Argument(reader.take(1)[0]);
+	switch (type) {
+	case Argument::Int: {
+		const auto value = reader.varint();
+		return QString::number(int64(value >> 1) ^ -int64(value & 1));
+	}
+	case Argument::UInt: return QString::number(reader.varint());
+	case Argument::Double: {
+		auto value = 0.;
+		const auto data = reader.take(sizeof(value));
+		if (!reader.failed()) {
+			memcpy(&value, data.data(), sizeof(value));
+		}
+		return QString::number(value);
+	}
+	case Argument::Utf8: return QString::fromUtf8(reader.string());
+	case Argument::Utf16: {
+		const auto length = reader.varint();
+		const auto data = reader.take(length * sizeof(char16_t));
+		return reader.failed()
+			? QString()
+			: QString(reinterpret_cast<const QChar*>(data.data()), length);
+	}
+	}
+	reader.fail();
+	return QString();
+}
+
+[[nodiscard]] QString Substitute(
+		const QString &format,
+		const std::vector<QString> &arguments) {
+	auto result = QString();
+	result.reserve(format.size());
+	for (auto i = 0, size = int(format.size()); i != size; ++i) {
+		const auto ch = format[i];
+		if (ch != '%' || i + 1 == size || !format[i + 1].isDigit()) {
+			result.append(ch);
+			continue;
+		}
+		auto index = 0;
+		auto j = i + 1;
+		for (; j != size && format[j].isDigit(); ++j) {
+			index = index * 10 + format[j].digitValue();
+		}
+		if (index > 0 && index <= int(arguments.size())) {
+			result.append(arguments[index - 1]);
+		} else {
+			result.append(format.mid(i, j - i));
+		}
+		i = j - 1;
+	}
+	return result;
+}
+
+} // namespace
+
+namespace details {
+
+not_null<Buffer*> BeginRecord(FormatId id, int count) {
+	const auto buffer = GlobalLog.buffer();
+	buffer->mutex.lock();
+	auto &data = buffer->data();
+	WriteVarint(data, id);
+	WriteVarint(data, uint64(std::max(crl::now() - GlobalLog.started(), crl::time(0))));
+	WriteVarint(data, buffer->thread());
+	data.push_back(bytes::type(uchar(count)));
+	return buffer;
+}
+
+void Append(not_null<Buffer*> buffer, int64 value) {
+	auto &data = buffer->data();
+	data.push_back(bytes::type(Argument::Int));
+	WriteVarint(data, (uint64(value) << 1) ^ uint64(value >> 63));
+}
+
+void Append(not_null<Buffer*> buffer, uint64 value) {
+	auto &data = buffer->data();
+	data.push_back(bytes::type(Argument::UInt));
+	WriteVarint(data, value);
+}
+
+void Append(not_null<Buffer*> buffer, double value) {
+	auto &data = buffer->data();
+	data.push_back(bytes::type(Argument::Double));
+	WriteRaw(data, &value, sizeof(value));
+}
+
+void Append(not_null<Buffer*> buffer, std::string_view value) {
+	auto &data = buffer->data();
+	data.push_back(bytes::type(Argument::Utf8));
+	WriteString(data, value);
+}
+
+void Append(not_null<Buffer*> buffer, const QString &value) {
+	auto &data = buffer->data();
+	data.push_back(bytes::type(Argument::Utf16));
+	WriteVarint(data, value.size());
+	WriteRaw(data, value.constData(), value.size() * sizeof(QChar));
+}
+
+void EndRecord(not_null<Buffer*> buffer) {
+	if (buffer->data().size() >= kFlushSize) {
+		GlobalLog.write(buffer);
+	}
+	buffer->mutex.unlock();
+}
+
+} // namespace details
+
+bool Start(const QString &path) {
+	return GlobalLog.start(path);
+}
+
+void Flush() {
+	GlobalLog.flush();
+}
+
+void Stop() {
+	GlobalLog.stop();
+}
+
+FormatId RegisterFormat(const char *format, const char *file, int line) {
+	return GlobalLog.registerFormat(format, file, line);
+}
+
+std::optional<QString> Decode(bytes::const_span data) {
+	auto reader = Reader(data);
+	const auto magic = reader.take(kMagic.size());
+	if (reader.failed()
+		|| memcmp(magic.data(), kMagic.data(), kMagic.size())
+		|| reader.varint() != kVersion) {
+		return std::nullopt;
+	}
+	const auto epoch = int64(reader.varint());
+	if (reader.failed()) {
+		return std::nullopt;
+	}
+
+	auto formats = std::vector<Format>();
+	auto result = QString();
+	auto arguments = std::vector<QString>();
+	while (!reader.atEnd() && !reader.failed()) {
+		const auto kind = Block(reader.take(1)[0]);
+		const auto size = reader.varint();
+		auto block = Reader(reader.take(size));
+		if (reader.failed()) {
+			// The last block is cut short after a crash, keep the rest.
+			result.append("(the log is truncated here)\n");
+			break;
+		} else if (kind == Block::Format) {
+			const auto id = block.varint();
+			const auto line = int(block.varint());
+			auto file = block.string();
+			auto format = block.string();
+			if (block.failed() || id != formats.size()) {
+				return std::nullopt;
+			}
+			formats.push_back({
+				.format = std::move(format),
+				.file = std::move(file),
+				.line = line,
+			});
+			continue;
+		} else if (kind != Block::Records) {
+			continue;
+		}
+		while (!block.atEnd() && !block.failed()) {
+			const auto id = block.varint();
+			const auto time = int64(block.varint());
+			const auto thread = block.varint();
+			const auto count = uchar(block.take(1)[0]);
+			arguments.clear();
+			for (auto i = 0; i != count; ++i) {
+				arguments.push_back(ArgumentText(block));
+			}
+			if (block.failed() || id >= formats.size()) {
+				return std::nullopt;
+			}
+			const auto &format = formats[id];
+			const auto when = QDateTime::fromMSecsSinceEpoch(epoch + time);
+			result.append('[' + when.toString("yyyy.MM.dd hh:mm:ss.zzz") + "] ");
+			result.append('[' + QString::number(thread) + "] ");
+			result.append(Substitute(QString::fromUtf8(format.format), arguments));
+			result.append(QString(" (%1 : %2)\n").arg(
+				QString::fromUtf8(format.file),
+				QString::number(format.line)));
+		}
+	}
+	return result;
+}
+
+} // namespace base::binary_log
@@ -0,0 +1,100 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+#include "base/assertion.h" // SOURCE_FILE_BASENAME
+#include "base/bytes.h"
+
+#include <QtCore/QString>
+
+#include <atomic>
+#include <optional>
+#include <string_view>
+
+// Structured logging that doesn't format anything at the call site.
+// Each record is a format string id with raw typed arguments, encoded
+// into a per-thread buffer and appended to a compact binary file. The
+// text is produced only by Decode(), see lib_base_binary_log_decoder.
+
+namespace base::binary_log {
+
+using FormatId = uint32;
+
+bool Start(const QString &path);
+void Flush();
+void Stop();
+
+[[nodiscard]] FormatId RegisterFormat(
+	const char *format,
+	const char *file,
+	int line);
+
+// Returns the log text, one record per line, or nothing if corrupted.
+// If the last block is cut short only the complete ones are decoded.
+[[nodiscard]] std::optional<QString> Decode(bytes::const_span data);
+
+namespace details {
+
+extern std::atomic<bool> Started;
+
+class Buffer;
+
+[[nodiscard]] not_null<Buffer*> BeginRecord(FormatId id, int count);
+void Append(not_null<Buffer*> buffer, int64 value);
+void Append(not_null<Buffer*> buffer, uint64 value);
+void Append(not_null<Buffer*> buffer, double value);
+void Append(not_null<Buffer*> buffer, std::string_view value);
+void Append(not_null<Buffer*> buffer, const QString &value);
+void EndRecord(not_null<Buffer*> buffer);
+
+template <typename Type>
+void AppendValue(not_null<Buffer*> buffer, const Type &value) {
+	if constexpr (std::is_enum_v<Type>) {
+		AppendValue(buffer, std::underlying_type_t<Type>(value));
+	} else if constexpr (std::is_same_v<Type, bool>
+		|| std::is_unsigned_v<Type>) {
+		Append(buffer, uint64(value));
+	} else if constexpr (std::is_integral_v<Type>) {
+		Append(buffer, int64(value));
+	} else if constexpr (std::is_floating_point_v<Type>) {
+		Append(buffer, double(value));
+	} else if constexpr (std::is_same_v<Type, QString>) {
+		Append(buffer, value);
+	} else if constexpr (std::is_same_v<Type, QByteArray>) {
+		Append(buffer, std::string_view(value.constData(), value.size()));
+	} else if constexpr (std::is_convertible_v<const Type&, std::string_view>) {
+		Append(buffer, std::string_view(value));
+	} else {
+		static_assert(sizeof(Type) == 0, "Unsupported binary log argument.");
+	}
+}
+
+} // namespace details
+
+[[nodiscard]] inline bool Started() {
+	return details::Started.load(std::memory_order_relaxed);
+}
+
+template <typename ...Args>
+void Write(FormatId id, const Args &...args) {
+	const auto buffer = details::BeginRecord(id, sizeof...(Args));
+	(details::AppendValue(buffer, args), ...);
+	details::EndRecord(buffer);
+}
+
+} // namespace base::binary_log
+
+#define BINARY_LOG(format, ...) {\
+	if (::base::binary_log::Started()) {\
+		static const auto BinaryLogFormatId = ::base::binary_log::RegisterFormat(\
+			format,\
+			SOURCE_FILE_BASENAME,\
+			__LINE__);\
+		::base::binary_log::Write(BinaryLogFormatId, ##__VA_ARGS__);\
+	}\
+}
+//usage BINARY_LOG("log: %1 %2", 1, "two")
@@ -0,0 +1,41 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/binary_log.h"
+
+#include <QtCore/QFile>
+
+#include <iostream>
+
+// Usage: lib_base_binary_log_decoder <binary log> [<text output>]
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <log> [<output>]" << std::endl;
+		return 1;
+	}
+	auto input = QFile(QFile::decodeName(argv[1]));
+	if (!input.open(QIODevice::ReadOnly)) {
+		std::cerr << "Could not open '" << argv[1] << "'." << std::endl;
+		return 1;
+	}
+	const auto data = input.readAll();
+	const auto text = base::binary_log::Decode(bytes::make_span(data));
+	if (!text) {
+		std::cerr << "Could not decode '" << argv[1] << "'." << std::endl;
+		return 1;
+	}
+	auto output = QFile();
+	const auto opened = (argc > 2)
+		? (output.setFileName(QFile::decodeName(argv[2])),
+			output.open(QIODevice::WriteOnly))
+		: output.open(stdout, QIODevice::WriteOnly);
+	if (!opened) {
+		std::cerr << "Could not open the output." << std::endl;
+		return 1;
+	}
+	output.write(text->toUtf8());
+	return 0;
+}
@@ -0,0 +1,536 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/compress.h"
+
+#include <zlib.h>
+#include <limits>
+
+#ifdef DESKTOP_APP_USE_ZSTD
+#include <zstd.h>
+#endif // DESKTOP_APP_USE_ZSTD
+
+namespace base::compress {
+namespace details {
+
+class Stream {
+public:
+	virtual ~Stream() = default;
+
+	[[nodiscard]] bool failed() const {
+		return _failed;
+	}
+	[[nodiscard]] bool finished() const {
+		return _finished;
+	}
+
+	void push(bytes::const_span input) {
+		process(input, Mode::Continue);
+	}
+	void flush() {
+		process({}, Mode::Flush);
+	}
+	void finish() {
+		process({}, Mode::Finish);
+	}
+	void reset() {
+		_failed = !resetState();
+		_finished = false;
+		_written = _pulled = 0;
+		_total = 0;
+	}
+
+	[[nodiscard]] bytes::const_span pull() {
+		const auto result = bytes::make_span(_output).subspan(
+			_pulled,
+			_written - _pulled);
+		_pulled = _written;
+		return result;
+	}
+
+protected:
+	enum class Mode {
+		Continue,
+		Flush,
+		Finish,
+	};
+	enum class Result {
+		Done,
+		More,
+		Finished,
+		Failed,
+	};
+
+	explicit Stream(int64 sizeLimit = -1) : _sizeLimit(sizeLimit) {
+	}
+
+	// Consumes the input and fills the output, advancing both spans.
+	[[nodiscard]] virtual Result step(
+		bytes::const_span &input,
+		bytes::span &output,
+		Mode mode) = 0;
+	[[nodiscard]] virtual bool resetState() = 0;
+
+private:
+	static constexpr auto kOutputChunk = std::size_t(64 * 1024);
+
+	void process(bytes::const_span input, Mode mode) {
+		if (_failed) {
+			return;
+		} else if (_finished) {
+			_failed = !input.empty();
+			return;
+		} else if (_pulled == _written) {
+			_written = _pulled = 0;
+		}
+		while (true) {
+			if (_output.size() - _written < kOutputChunk) {
+				_output.resize(std::max(
+					_output.size() * 2,
+					_written + kOutputChunk));
+			}
+			auto output = bytes::make_span(_output).subspan(_written);
+			const auto available = output.size();
+			const auto result = step(input, output, mode);
+			const auto produced = available - output.size();
+			_written += produced;
+			_total += produced;
+			if (result == Result::Failed
+				|| (_sizeLimit >= 0 && _total > _sizeLimit)) {
+				_failed = true;
+				return;
+			} else if (result == Result::Finished) {
+				_finished = true;
+				_failed = !input.empty();
+				return;
+			} else if (result == Result::Done) {
+				return;
+			}
+		}
+	}
+
+	bytes::vector _output;
+	std::size_t _written = 0;
+	std::size_t _pulled = 0;
+	int64 _total = 0;
+	int64 _sizeLimit = -1;
+	bool _failed = false;
+	bool _finished = false;
+
+};
+
+} // namespace details
+
+namespace {
+
+using details::Stream;
+
+[[nodiscard]] int WindowBits(Format format) {
+	return (format == Format::Gzip) ? (MAX_WBITS + 16) : -MAX_WBITS;
+}
+
+void Attach(z_stream &stream, bytes::const_span input, bytes::span output) {
+	constexpr auto kMax = std::size_t(std::numeric_limits<uInt>::max());
+	stream.next_in = reinterpret_cast<Bytef*>(
+		const_cast<bytes::type*>(input.data()));
+	stream.avail_in = uInt(std::min(input.size(), kMax));
+	stream.next_out = reinterpret_cast<Bytef*>(output.data());
+	stream.avail_out = uInt(std::min(output.size(), kMax));
+}
+
+class DeflateEncoder final : public Stream {
+public:
+	DeflateEncoder(Format format, int level) {
+		_initialized = (deflateInit2(
+			&_stream,
+			level,
+			Z_DEFLATED,
+			WindowBits(format),
+			8,
+			Z_DEFAULT_STRATEGY) == Z_OK);
+	}
+	~DeflateEncoder() {
+		if (_initialized) {
+			deflateEnd(&_stream);
+		}
+	}
+
+	[[nodiscard]] bool initialized() const {
+		return _initialized;
+	}
+
+private:
+	Result step(
+			bytes::const_span &input,
+			bytes::span &output,
+			Mode mode) override {
+		Attach(_stream, input, output);
+		const auto availableIn = _stream.avail_in;
+		const auto availableOut = _stream.avail_out;
+		const auto code = deflate(&_stream, (mode == Mode::Finish)
+			? Z_FINISH
+			: (mode == Mode::Flush)
+			? Z_SYNC_FLUSH
+			: Z_NO_FLUSH);
+		input = input.subspan(availableIn - _stream.avail_in);
+		output = output.subspan(availableOut - _stream.avail_out);
+		if (code == Z_STREAM_END) {
+			return Result::Finished;
+		} else if (code != Z_OK && code != Z_BUF_ERROR) {
+			return Result::Failed;
+		} else if (!_stream.avail_out
+			|| !input.empty()
+			|| mode == Mode::Finish) {
+			return Result::More;
+		}
+		return Result::Done;
+	}
+	bool resetState() override {
+		return _initialized && (deflateReset(&_stream) == Z_OK);
+	}
+
+	z_stream _stream = z_stream();
+	bool _initialized = false;
+
+};
+
+class DeflateDecoder final : public Stream {
+public:
+	DeflateDecoder(Format format, int64 sizeLimit) : Stream(sizeLimit) {
+		_initialized = (inflateInit2(
+			&_stream,
+			WindowBits(format)) == Z_OK);
+	}
+	~DeflateDecoder() {
+		if (_initialized) {
+			inflateEnd(&_stream);
+		}
+	}
+
+	[[nodiscard]] bool initialized() const {
+		return _initialized;
+	}
+
+private:
+	Result step(
+			bytes::const_span &input,
+			bytes::span &output,
+			Mode mode) override {
+		Attach(_stream, input, output);
+		const auto availableIn = _stream.avail_in;
+		const auto availableOut = _stream.avail_out;
+		const auto code = inflate(&_stream, Z_NO_FLUSH);
+		input = input.subspan(availableIn - _stream.avail_in);
+		output = output.subspan(availableOut - _stream.avail_out);
+		if (code == Z_STREAM_END) {
+			return Result::Finished;
+		} else if (code != Z_OK && code != Z_BUF_ERROR) {
+			return Result::Failed;
+		} else if (!_stream.avail_out || !input.empty()) {
+			return Result::More;
+		}
+		return Result::Done;
+	}
+	bool resetState() override {
+		return _initialized && (inflateReset(&_stream) == Z_OK);
+	}
+
+	z_stream _stream = z_stream();
+	bool _initialized = false;
+
+};
+
+#ifdef DESKTOP_APP_USE_ZSTD
+
+class ZstdEncoder final : public Stream {
+public:
+	explicit ZstdEncoder(int level) : _context(ZSTD_createCCtx()) {
+		if (_context) {
+			ZSTD_CCtx_setParameter(
+				_context,
+				ZSTD_c_compressionLevel,
+				(level == kDefaultLevel) ? ZSTD_CLEVEL_DEFAULT : level);
+		}
+	}
+	~ZstdEncoder() {
+		ZSTD_freeCCtx(_context);
+	}
+
+	[[nodiscard]] bool initialized() const {
+		return (_context != nullptr);
+	}
+
+private:
+	Result step(
+			bytes::const_span &input,
+			bytes::span &output,
+			Mode mode) override {
+		auto in = ZSTD_inBuffer{ input.data(), input.size(), 0 };
+		auto out = ZSTD_outBuffer{ output.data(), output.size(), 0 };
+		const auto left = ZSTD_compressStream2(
+			_context,
+			&out,
+			&in,
+			(mode == Mode::Finish)
+				? ZSTD_e_end
+				: (mode == Mode::Flush)
+				? ZSTD_e_flush
+				: ZSTD_e_continue);
+		input = input.subspan(in.pos);
+		output = output.subspan(out.pos);
+		if (ZSTD_isError(left)) {
+			return Result::Failed;
+		} else if (mode == Mode::Continue) {
+			return input.empty() ? Result::Done : Result::More;
+		} else if (left) {
+			return Result::More;
+		}
+		return (mode == Mode::Finish) ? Result::Finished : Result::Done;
+	}
+	bool resetState() override {
+		return _context && !ZSTD_isError(
+			ZSTD_CCtx_reset(_context, ZSTD_reset_session_only));
+	}
+
+	ZSTD_CCtx *_context = nullptr;
+
+};
+
+class ZstdDecoder final : public Stream {
+public:
+	explicit ZstdDecoder(int64 sizeLimit)
+	: Stream(sizeLimit)
+	, _context(ZSTD_createDCtx()) {
+	}
+	~ZstdDecoder() {
+		ZSTD_freeDCtx(_context);
+	}
+
+	[[nodiscard]] bool initialized() const {
+		return (_context != nullptr);
+	}
+
+private:
+	Result step(
+			bytes::const_span &input,
+			bytes::span &output,
+			Mode mode) override {
+		auto in = ZSTD_inBuffer{ input.data(), input.size(), 0 };
+		auto out = ZSTD_outBuffer{ output.data(), output.size(), 0 };
+		const auto result = ZSTD_decompressStream(_context, &out, &in);
+		input = input.subspan(in.pos);
+		output = output.subspan(out.pos);
+		if (ZSTD_isError(result)) {
+			return Result::Failed;
+		} else if (!result) {
+			return Result::Finished;
+		} else if (output.empty() || !input.empty()) {
+			return Result::More;
+		}
+		return Result::Done;
+	}
+	bool resetState() override {
+		return _context && !ZSTD_isError(
+			ZSTD_DCtx_reset(_context, ZSTD_reset_session_only));
+	}
+
+	ZSTD_DCtx *_context = nullptr;
+
+};
+
+#endif // DESKTOP_APP_USE_ZSTD
+
+template <typename Type, typename ...Args>
+[[nodiscard]] std::unique_ptr<Stream> MakeStream(Args &&...args) {
+	auto result = std::make_unique<Type>(std::forward<Args>(args)...);
+	return result->initialized() ? std::move(result) : nullptr;
+}
+
+[[nodiscard]] std::unique_ptr<Stream> MakeEncoder(Format format, int level) {
+	if (level != kDefaultLevel
+		&& (level < MinLevel(format) || level > MaxLevel(format))) {
+		return nullptr;
+	}
+	switch (format) {
+	case Format::Deflate:
+	case Format::Gzip: return MakeStream<DeflateEncoder>(format, level);
+#ifdef DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return MakeStream<ZstdEncoder>(level);
+#else // DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return nullptr;
+#endif // DESKTOP_APP_USE_ZSTD
+	}
+	return nullptr;
+}
+
+[[nodiscard]] std::unique_ptr<Stream> MakeDecoder(
+		Format format,
+		int64 sizeLimit) {
+	switch (format) {
+	case Format::Deflate:
+	case Format::Gzip: return MakeStream<DeflateDecoder>(format, sizeLimit);
+#ifdef DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return MakeStream<ZstdDecoder>(sizeLimit);
+#else // DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return nullptr;
+#endif // DESKTOP_APP_USE_ZSTD
+	}
+	return nullptr;
+}
+
+} // namespace
+
+bool Available(Format format) {
+	switch (format) {
+	case Format::Deflate:
+	case Format::Gzip: return true;
+#ifdef DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return true;
+#else // DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return false;
+#endif // DESKTOP_APP_USE_ZSTD
+	}
+	return false;
+}
+
+int MinLevel(Format format) {
+	switch (format) {
+	case Format::Deflate:
+	case Format::Gzip: return Z_NO_COMPRESSION;
+#ifdef DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return 1;
+#else // DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return 0;
+#endif // DESKTOP_APP_USE_ZSTD
+	}
+	return 0;
+}
+
+int MaxLevel(Format format) {
+	switch (format) {
+	case Format::Deflate:
+	case Format::Gzip: return Z_BEST_COMPRESSION;
+#ifdef DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return ZSTD_maxCLevel();
+#else // DESKTOP_APP_USE_ZSTD
+	case Format::Zstd: return 0;
+#endif // DESKTOP_APP_USE_ZSTD
+	}
+	return 0;
+}
+
+Encoder::Encoder(Format format, int level)
+: _stream(MakeEncoder(format, level)) {
+}
+
+Encoder::Encoder(Encoder &&other) noexcept = default;
+
+Encoder &Encoder::operator=(Encoder &&other) noexcept = default;
+
+Encoder::~Encoder() = default;
+
+bool Encoder::valid() const {
+	return (_stream != nullptr);
+}
+
+bool Encoder::failed() const {
+	return !_stream || _stream->failed();
+}
+
+void Encoder::push(bytes::const_span input) {
+	if (_stream) {
+		_stream->push(input);
+	}
+}
+
+void Encoder::flush() {
+	if (_stream) {
+		_stream->flush();
+	}
+}
+
+void Encoder::finish() {
+	if (_stream) {
+		_stream->finish();
+	}
+}
+
+void Encoder::reset() {
+	if (_stream) {
+		_stream->reset();
+	}
+}
+
+bytes::const_span Encoder::pull() {
+	return _stream ? _stream->pull() : bytes::const_span();
+}
+
+Decoder::Decoder(Format format, int64 sizeLimit)
+: _stream(MakeDecoder(format, sizeLimit)) {
+}
+
+Decoder::Decoder(Decoder &&other) noexcept = default;
+
+Decoder &Decoder::operator=(Decoder &&other) noexcept = default;
+
+Decoder::~Decoder() = default;
+
+bool Decoder::valid() const {
+	return (_stream != nullptr);
+}
+
+bool Decoder::failed() const {
+	return !_stream || _stream->failed();
+}
+
+bool Decoder::finished() const {
+	return _stream && _stream->finished();
+}
+
+void Decoder::push(bytes::const_span input) {
+	if (_stream) {
+		_stream->push(input);
+	}
+}
+
+void Decoder::reset() {
+	if (_stream) {
+		_stream->reset();
+	}
+}
+
+bytes::const_span Decoder::pull() {
+	return _stream ? _stream->pull() : bytes::const_span();
+}
+
+std::optional<bytes::vector> Compress(
+		bytes::const_span data,
+		Format format,
+		int level) {
+	auto encoder = Encoder(format, level);
+	encoder.push(data);
+	encoder.finish();
+	if (encoder.failed()) {
+		return std::nullopt;
+	}
+	const auto result = encoder.pull();
+	return bytes::vector(result.begin(), result.end());
+}
+
+std::optional<bytes::vector> Decompress(
+		bytes::const_span data,
+		Format format,
+		int64 sizeLimit) {
+	auto decoder = Decoder(format, sizeLimit);
+	decoder.push(data);
+	if (decoder.failed() || !decoder.finished()) {
+		return std::nullopt;
+	}
+	const auto result = decoder.pull();
+	return bytes::vector(result.begin(), result.end());
+}
+
+} // namespace base::compress
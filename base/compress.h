@@ -0,0 +1,91 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+#include "base/bytes.h"
+
+#include <optional>
+
+namespace base::compress {
+
+enum class Format : uchar {
+	Deflate, // Raw deflate stream, without any header.
+	Gzip,
+	Zstd,
+};
+
+inline constexpr auto kDefaultLevel = -1;
+
+[[nodiscard]] bool Available(Format format);
+
+// Levels are 0..9 for deflate / gzip and 1..22 for zstd.
+[[nodiscard]] int MinLevel(Format format);
+[[nodiscard]] int MaxLevel(Format format);
+
+namespace details {
+
+class Stream;
+
+} // namespace details
+
+// Push input spans in, pull produced output out. After finish() the
+// encoder may be reset() to start a new message, keeping its window.
+class Encoder final {
+public:
+	explicit Encoder(Format format, int level = kDefaultLevel);
+	Encoder(Encoder &&other) noexcept;
+	Encoder &operator=(Encoder &&other) noexcept;
+	~Encoder();
+
+	[[nodiscard]] bool valid() const;
+	[[nodiscard]] bool failed() const;
+
+	void push(bytes::const_span input);
+	void flush();
+	void finish();
+	void reset();
+
+	// The result is valid until the next call of a non-const method.
+	[[nodiscard]] bytes::const_span pull();
+
+private:
+	std::unique_ptr<details::Stream> _stream;
+
+};
+
+class Decoder final {
+public:
+	explicit Decoder(Format format, int64 sizeLimit = -1);
+	Decoder(Decoder &&other) noexcept;
+	Decoder &operator=(Decoder &&other) noexcept;
+	~Decoder();
+
+	[[nodiscard]] bool valid() const;
+	[[nodiscard]] bool failed() const;
+	[[nodiscard]] bool finished() const;
+
+	void push(bytes::const_span input);
+	void reset();
+
+	// The result is valid until the next call of a non-const method.
+	[[nodiscard]] bytes::const_span pull();
+
+private:
+	std::unique_ptr<details::Stream> _stream;
+
+};
+
+[[nodiscard]] std::optional<bytes::vector> Compress(
+	bytes::const_span data,
+	Format format,
+	int level = kDefaultLevel);
+[[nodiscard]] std::optional<bytes::vector> Decompress(
+	bytes::const_span data,
+	Format format,
+	int64 sizeLimit = -1);
+
+} // namespace base::compress
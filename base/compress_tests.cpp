@@ -0,0 +1,120 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/compress.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace base::compress;
+
+namespace {
+
+[[nodiscard]] std::string SampleText(int lines) {
+	auto result = std::string();
+	for (auto i = 0; i != lines; ++i) {
+		result += "{\"id\":" + std::to_string(i * 7919 % 1000)
+			+ ",\"name\":\"line " + std::to_string(i) + "\"}\n";
+	}
+	return result;
+}
+
+[[nodiscard]] bytes::const_span AsSpan(const std::string &text) {
+	return bytes::make_span(text.data(), text.size());
+}
+
+[[nodiscard]] bool Equal(bytes::const_span a, const std::string &b) {
+	return !bytes::compare(a, AsSpan(b));
+}
+
+} // namespace
+
+TEST_CASE("compress round trips", "[compress]") {
+	const auto text = SampleText(10000);
+	for (const auto format : { Format::Deflate, Format::Gzip, Format::Zstd }) {
+		if (!Available(format)) {
+			continue;
+		}
+		const auto packed = Compress(AsSpan(text), format);
+		REQUIRE(packed.has_value());
+		REQUIRE(packed->size() < text.size());
+		const auto unpacked = Decompress(*packed, format);
+		REQUIRE(unpacked.has_value());
+		REQUIRE(Equal(*unpacked, text));
+
+		REQUIRE(!Decompress(*packed, format, text.size() - 1));
+		REQUIRE(Decompress(*packed, format, text.size()).has_value());
+	}
+}
+
+TEST_CASE("compress streams reuse state between messages", "[compress]") {
+	const auto text = SampleText(10000);
+	const auto append = [](bytes::vector &to, bytes::const_span what) {
+		to.insert(end(to), what.begin(), what.end());
+	};
+	for (const auto format : { Format::Deflate, Format::Gzip, Format::Zstd }) {
+		if (!Available(format)) {
+			continue;
+		}
+		auto encoder = Encoder(format);
+		auto decoder = Decoder(format);
+		for (auto message = 0; message != 3; ++message) {
+			auto packed = bytes::vector();
+			const auto all = AsSpan(text);
+			for (auto i = std::size_t(); i < all.size(); i += 1000) {
+				encoder.push(all.subspan(i, std::min(std::size_t(1000), all.size() - i)));
+				append(packed, encoder.pull());
+			}
+			encoder.finish();
+			append(packed, encoder.pull());
+			REQUIRE(!encoder.failed());
+
+			auto unpacked = bytes::vector();
+			for (auto i = std::size_t(); i < packed.size(); i += 100) {
+				decoder.push(bytes::make_span(packed).subspan(i, std::min(std::size_t(100), packed.size() - i)));
+				append(unpacked, decoder.pull());
+			}
+			REQUIRE(decoder.finished());
+			REQUIRE(Equal(unpacked, text));
+
+			encoder.reset();
+			decoder.reset();
+		}
+	}
+}
+
+TEST_CASE("compress throughput", "[.][compress][benchmark]") {
+	using Clock = std::chrono::steady_clock;
+	const auto text = SampleText(200000);
+	for (const auto format : { Format::Deflate, Format::Gzip, Format::Zstd }) {
+		if (!Available(format)) {
+			continue;
+		}
+		for (auto level = MinLevel(format); level <= MaxLevel(format); ++level) {
+			const auto start = Clock::now();
+			const auto packed = Compress(AsSpan(text), format, level);
+			const auto middle = Clock::now();
+			const auto unpacked = Decompress(*packed, format);
+			const auto finish = Clock::now();
+			REQUIRE(unpacked.has_value());
+
+			const auto megabytes = text.size() / (1024. * 1024.);
+			const auto seconds = [](auto duration) {
+				return std::chrono::duration<double>(duration).count();
+			};
+			std::cout
+				<< "format " << int(format)
+				<< " level " << level
+				<< ": ratio " << (double(packed->size()) / text.size())
+				<< ", compress " << (megabytes / seconds(middle - start))
+				<< " MB/s, decompress " << (megabytes / seconds(finish - middle))
+				<< " MB/s" << std::endl;
+		}
+	}
+}
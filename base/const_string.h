@@ -8,6 +8,10 @@
 
 #include <QtCore/QString>
 #include <QtCore/QByteArray>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <string_view>
 
 namespace base {
@@ -26,10 +30,188 @@ public:
 
 };
 
+class interned_string;
+
+namespace details {
+
+template <std::size_t N>
+struct InternedLiteral {
+	constexpr InternedLiteral(const char (&text)[N]) {
+		std::copy_n(text, N, utf8);
+	}
+
+	char utf8[N] = {};
+};
+
+struct InternedData {
+	std::string_view utf8;
+	std::u16string_view utf16;
+	std::uint64_t hash = 0;
+};
+
+[[nodiscard]] constexpr std::uint64_t InternedHash(std::string_view text) {
+	auto result = std::uint64_t(0xCBF29CE484222325ULL);
+	for (const auto ch : text) {
+		result = (result ^ std::uint8_t(ch)) * 0x100000001B3ULL;
+	}
+	return result;
+}
+
+// Returns false on any invalid UTF-8 sequence.
+template <typename Callback>
+[[nodiscard]] constexpr bool ForEachCodePoint(
+		std::string_view text,
+		Callback &&callback) {
+	constexpr std::uint32_t kMinimal[] = { 0, 0, 0x80, 0x800, 0x10000 };
+	for (auto i = std::size_t(0); i != text.size();) {
+		const auto lead = std::uint8_t(text[i]);
+		const auto length = (lead < 0x80)
+			? 1
+			: ((lead & 0xE0) == 0xC0)
+			? 2
+			: ((lead & 0xF0) == 0xE0)
+			? 3
+			: ((lead & 0xF8) == 0xF0)
+			? 4
+			: 0;
+		if (!length || text.size() - i < std::size_t(length)) {
+			return false;
+		}
+		auto code = std::uint32_t((length == 1)
+			? lead
+			: (lead & (0x7F >> length)));
+		for (auto j = 1; j != length; ++j) {
+			const auto next = std::uint8_t(text[i + j]);
+			if ((next & 0xC0) != 0x80) {
+				return false;
+			}
+			code = (code << 6) | (next & 0x3F);
+		}
+		if (code < kMinimal[length]
+			|| code > 0x10FFFF
+			|| (code >= 0xD800 && code < 0xE000)) {
+			return false;
+		}
+		callback(code);
+		i += length;
+	}
+	return true;
+}
+
+[[nodiscard]] constexpr int InternedUtf16Length(std::string_view text) {
+	auto result = 0;
+	const auto valid = ForEachCodePoint(text, [&](std::uint32_t code) {
+		result += (code >= 0x10000) ? 2 : 1;
+	});
+	return valid ? result : -1;
+}
+
+template <int Length>
+[[nodiscard]] constexpr auto InternedUtf16(std::string_view text) {
+	auto result = std::array<char16_t, Length + 1>();
+	auto i = 0;
+	[[maybe_unused]] const auto valid = ForEachCodePoint(text, [&](
+			std::uint32_t code) {
+		if (code >= 0x10000) {
+			code -= 0x10000;
+			result[i++] = char16_t(0xD800 | (code >> 10));
+			result[i++] = char16_t(0xDC00 | (code & 0x3FF));
+		} else {
+			result[i++] = char16_t(code);
+		}
+	});
+	return result;
+}
+
+template <InternedLiteral Text>
+struct Interned {
+	static constexpr auto utf8 = std::string_view(
+		Text.utf8,
+		sizeof(Text.utf8) - 1);
+	static constexpr auto length = InternedUtf16Length(utf8);
+	static_assert(length >= 0, "Invalid UTF-8 in an interned string.");
+
+	static constexpr auto utf16 = InternedUtf16<length>(utf8);
+	static constexpr auto data = InternedData{
+		.utf8 = utf8,
+		.utf16 = std::u16string_view(utf16.data(), length),
+		.hash = InternedHash(utf8),
+	};
+};
+
+} // namespace details
+} // namespace base
+
+template <base::details::InternedLiteral Text>
+[[nodiscard]] constexpr base::interned_string operator""_is();
+
+namespace base {
+
+// Converted and hashed at compile time, stored in read-only static data.
+// The same literal always gives the same pointer, so interned strings are
+// compared by pointer only (inside one binary module).
+class interned_string final {
+public:
+	[[nodiscard]] constexpr std::string_view view() const {
+		return _data->utf8;
+	}
+	[[nodiscard]] constexpr std::u16string_view view16() const {
+		return _data->utf16;
+	}
+	[[nodiscard]] constexpr std::uint64_t hash() const {
+		return _data->hash;
+	}
+	[[nodiscard]] constexpr const_string cs() const {
+		return { _data->utf8.data(), _data->utf8.size() };
+	}
+
+	// Both don't allocate or convert anything.
+	[[nodiscard]] QString utf16() const {
+		return QString::fromRawData(
+			reinterpret_cast<const QChar*>(_data->utf16.data()),
+			_data->utf16.size());
+	}
+	[[nodiscard]] QByteArray utf8() const {
+		return QByteArray::fromRawData(
+			_data->utf8.data(),
+			_data->utf8.size());
+	}
+
+	friend inline constexpr bool operator==(
+			interned_string a,
+			interned_string b) {
+		return (a._data == b._data);
+	}
+
+private:
+	// Only the literal may create it, for the pointer comparison to work.
+	template <details::InternedLiteral Text>
+	friend constexpr interned_string (::operator""_is)();
+
+	constexpr explicit interned_string(const details::InternedData &data)
+	: _data(&data) {
+	}
+
+	const details::InternedData *_data = nullptr;
+
+};
+
 } // namespace base
 
+template <>
+struct std::hash<base::interned_string> {
+	[[nodiscard]] std::size_t operator()(base::interned_string value) const {
+		return std::size_t(value.hash());
+	}
+};
+
 [[nodiscard]] inline constexpr base::const_string operator""_cs(
 		const char *data,
 		std::size_t size) {
 	return { data, size };
 }
+
+template <base::details::InternedLiteral Text>
+[[nodiscard]] constexpr base::interned_string operator""_is() {
+	return base::interned_string(base::details::Interned<Text>::data);
+}
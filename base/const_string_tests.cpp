@@ -0,0 +1,68 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/const_string.h"
+
+#include <chrono>
+#include <iostream>
+#include <unordered_set>
+
+static_assert("Shift"_is == "Shift"_is);
+static_assert("Shift"_is.view() == "Shift");
+static_assert("Shift"_is.view16() == u"Shift");
+static_assert("\xD0\xB4\xF0\x9F\x98\x80"_is.view16() == u"д\U0001F600");
+static_assert(base::details::InternedUtf16Length("\xC0\x80") < 0);
+static_assert(base::details::InternedUtf16Length("\xED\xA0\x80") < 0);
+static_assert(base::details::InternedUtf16Length("\xF4\x90\x80\x80") < 0);
+static_assert(!std::is_constructible_v<
+	base::interned_string,
+	const base::details::InternedData&>);
+
+TEST_CASE("interned strings", "[const_string]") {
+	const auto shift = "Shift"_is;
+	const auto alt = "Alt"_is;
+
+	REQUIRE(shift == "Shift"_is);
+	REQUIRE(!(shift == alt));
+	REQUIRE(shift.utf16() == QString("Shift"));
+	REQUIRE(shift.utf8() == QByteArray("Shift"));
+	REQUIRE(shift.cs().utf16() == shift.utf16());
+	REQUIRE("\xD0\xB4\xF0\x9F\x98\x80"_is.utf16()
+		== QString::fromUtf8("\xD0\xB4\xF0\x9F\x98\x80"));
+	REQUIRE(""_is.utf16().isEmpty());
+
+	auto set = std::unordered_set<base::interned_string>{ shift, alt };
+	REQUIRE(set.contains("Alt"_is));
+	REQUIRE(!set.contains("Meta"_is));
+}
+
+TEST_CASE("interned strings throughput", "[.][const_string][benchmark]") {
+	using Clock = std::chrono::steady_clock;
+	constexpr auto kCount = 1000000;
+	const auto constant = "Right Super"_cs;
+	const auto interned = "Right Super"_is;
+	auto checksum = 0;
+	const auto constantStart = Clock::now();
+	for (auto i = 0; i != kCount; ++i) {
+		checksum += constant.utf16().size();
+	}
+	const auto internedStart = Clock::now();
+	for (auto i = 0; i != kCount; ++i) {
+		checksum += interned.utf16().size();
+	}
+	const auto finish = Clock::now();
+	const auto ns = [](auto duration) {
+		return std::chrono::duration<double, std::nano>(duration).count()
+			/ kCount;
+	};
+	std::cout
+		<< "const_string::utf16: " << ns(internedStart - constantStart)
+		<< " ns, interned_string::utf16: " << ns(finish - internedStart)
+		<< " ns (" << (checksum & 1) << ")"
+		<< std::endl;
+}
@@ -6,12 +6,83 @@
 //
 #include "base/crash_report_header.h"
 
+#include <atomic>
+#include <optional>
+
 namespace base::details {
 namespace {
 
+// When the crash handler interrupts a writer of the same thread
+// the value will never become consistent, so don't wait forever.
+constexpr auto kReadAttempts = 64;
+
+enum class SlotState : uint32 {
+	Empty,
+	Claiming,
+	Ready,
+};
+
+struct AnnotationSlot {
+	std::atomic<SlotState> state = SlotState::Empty;
+	std::atomic<uint32> version = 0; // Odd while the value is written.
+	char key[kReportAnnotationKeySize] = { 0 };
+	char value[kReportAnnotationValueSize] = { 0 };
+};
+
+struct BreadcrumbSlot {
+	std::atomic<uint64> version = 0; // 2 * index + 1 while written.
+	crl::time when = 0;
+	char text[kReportBreadcrumbSize] = { 0 };
+};
+
 std::array<char, kReportHeaderSizeLimit> Bytes;
 int Length = 0;
 
+std::array<AnnotationSlot, kReportAnnotationsCount> Annotations;
+std::array<BreadcrumbSlot, kReportBreadcrumbsCount> Breadcrumbs;
+std::atomic<uint64> BreadcrumbsAdded/* = 0*/;
+
+template <size_t Size>
+void CopyText(char (&to)[Size], std::string_view text) {
+	const auto length = std::min(text.size(), Size - 1);
+	memcpy(to, text.data(), length);
+	to[length] = 0;
+}
+
+void WriteAnnotationValue(AnnotationSlot &slot, std::string_view value) {
+	auto version = slot.version.load(std::memory_order_relaxed);
+	while ((version & 1)
+		|| !slot.version.compare_exchange_weak(
+			version,
+			version + 1,
+			std::memory_order_acquire)) {
+		if (version & 1) {
+			version = slot.version.load(std::memory_order_relaxed);
+		}
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	CopyText(slot.value, value);
+	slot.version.store(version + 2, std::memory_order_release);
+}
+
+[[nodiscard]] bool ReadAnnotationValue(
+		const AnnotationSlot &slot,
+		char (&to)[kReportAnnotationValueSize]) {
+	for (auto i = 0; i != kReadAttempts; ++i) {
+		const auto version = slot.version.load(std::memory_order_acquire);
+		if (version & 1) {
+			continue;
+		}
+		memcpy(to, slot.value, sizeof(to));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.version.load(std::memory_order_relaxed) == version) {
+			to[sizeof(to) - 1] = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
 void SafeWriteChar(char ch) {
 	if (Length < kReportHeaderSizeLimit) {
 		Bytes[Length++] = ch;
@@ -38,6 +109,24 @@ void SafeWriteNumber(Type number) {
 	}
 }
 
+[[nodiscard]] std::optional<crl::time> ReadBreadcrumb(
+		uint64 index,
+		char (&to)[kReportBreadcrumbSize]) {
+	const auto &slot = Breadcrumbs[index % kReportBreadcrumbsCount];
+	const auto version = 2 * index + 2;
+	if (slot.version.load(std::memory_order_acquire) != version) {
+		return std::nullopt;
+	}
+	const auto when = slot.when;
+	memcpy(to, slot.text, sizeof(to));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.version.load(std::memory_order_relaxed) != version) {
+		return std::nullopt;
+	}
+	to[sizeof(to) - 1] = 0;
+	return when;
+}
+
 } // namespace
 
 ReportHeaderWriter operator<<(ReportHeaderWriter, const char *str) {
@@ -109,4 +198,125 @@ int ReportHeaderLength() {
 	return Length;
 }
 
+void SetReportAnnotation(std::string_view key, std::string_view value) {
+	key = key.substr(0, kReportAnnotationKeySize - 1);
+	for (auto &slot : Annotations) {
+		auto state = slot.state.load(std::memory_order_acquire);
+		if (state == SlotState::Empty
+			&& slot.state.compare_exchange_strong(
+				state,
+				SlotState::Claiming,
+				std::memory_order_acquire)) {
+			CopyText(slot.key, key);
+			WriteAnnotationValue(slot, value);
+			slot.state.store(SlotState::Ready, std::memory_order_release);
+			return;
+		}
+		// Slots are claimed in order, this one may get the same key.
+		while (state == SlotState::Claiming) {
+			state = slot.state.load(std::memory_order_acquire);
+		}
+		if (std::string_view(slot.key) == key) {
+			WriteAnnotationValue(slot, value);
+			return;
+		}
+	}
+}
+
+void AddReportBreadcrumb(std::string_view text, crl::time when) {
+	const auto index = BreadcrumbsAdded.fetch_add(
+		1,
+		std::memory_order_relaxed);
+	auto &slot = Breadcrumbs[index % kReportBreadcrumbsCount];
+	auto version = slot.version.load(std::memory_order_relaxed);
+	while (true) {
+		if (version & 1) {
+			version = slot.version.load(std::memory_order_relaxed);
+		} else if (version > 2 * index + 2) {
+			return; // Overwritten by a newer one already.
+		} else if (slot.version.compare_exchange_weak(
+				version,
+				2 * index + 1,
+				std::memory_order_acquire)) {
+			break;
+		}
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.when = when;
+	CopyText(slot.text, text);
+	slot.version.store(2 * index + 2, std::memory_order_release);
+}
+
+std::map<std::string, std::string> ReportAnnotations() {
+	auto result = std::map<std::string, std::string>();
+	char value[kReportAnnotationValueSize];
+	for (const auto &slot : Annotations) {
+		const auto state = slot.state.load(std::memory_order_acquire);
+		if (state == SlotState::Empty) {
+			break;
+		} else if (state == SlotState::Ready
+			&& ReadAnnotationValue(slot, value)) {
+			result.emplace(slot.key, value);
+		}
+	}
+	return result;
+}
+
+std::vector<ReportBreadcrumb> ReportBreadcrumbs() {
+	auto result = std::vector<ReportBreadcrumb>();
+	const auto added = BreadcrumbsAdded.load(std::memory_order_acquire);
+	const auto from = (added > kReportBreadcrumbsCount)
+		? (added - kReportBreadcrumbsCount)
+		: uint64(0);
+	char text[kReportBreadcrumbSize];
+	for (auto index = from; index != added; ++index) {
+		if (const auto when = ReadBreadcrumb(index, text)) {
+			result.push_back({ .when = *when, .text = text });
+		}
+	}
+	return result;
+}
+
+void WriteReportAnnotations() {
+	char value[kReportAnnotationValueSize];
+	for (const auto &slot : Annotations) {
+		const auto state = slot.state.load(std::memory_order_acquire);
+		if (state == SlotState::Empty) {
+			break;
+		} else if (state == SlotState::Ready) {
+			const auto read = ReadAnnotationValue(slot, value);
+			ReportHeaderWriter()
+				<< slot.key
+				<< ": "
+				<< (read ? value : "(being updated)")
+				<< "\n";
+		}
+	}
+}
+
+void WriteReportBreadcrumbs(crl::time now) {
+	const auto added = BreadcrumbsAdded.load(std::memory_order_acquire);
+	if (!added) {
+		return;
+	}
+	const auto from = (added > kReportBreadcrumbsCount)
+		? (added - kReportBreadcrumbsCount)
+		: uint64(0);
+	char text[kReportBreadcrumbSize];
+	ReportHeaderWriter() << "Breadcrumbs:\n";
+	for (auto index = from; index != added; ++index) {
+		const auto when = ReadBreadcrumb(index, text);
+		if (!when) {
+			continue;
+		}
+		ReportHeaderWriter()
+			<< "-"
+			<< uint64(std::max(now - *when, crl::time(0)))
+			<< " ms: "
+			<< text
+			<< "\n";
+	}
+	ReportHeaderWriter() << "\n";
+}
+
 } // namespace base::details
@@ -6,6 +6,11 @@
 //
 #pragma once
 
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
 namespace base::details {
 
 inline constexpr auto kReportHeaderSizeLimit = 64 * 1024;
@@ -24,4 +29,35 @@ ReportHeaderWriter operator<<(ReportHeaderWriter, double num);
 [[nodiscard]] const char *ReportHeaderBytes();
 [[nodiscard]] int ReportHeaderLength();
 
+inline constexpr auto kReportAnnotationsCount = 64;
+inline constexpr auto kReportAnnotationKeySize = 64;
+inline constexpr auto kReportAnnotationValueSize = 256;
+inline constexpr auto kReportBreadcrumbsCount = 64;
+inline constexpr auto kReportBreadcrumbSize = 128;
+
+// "key: value\n" and "-<ms> ms: text\n" lines with their titles take
+// at most a half of the header, the rest is for the signal and stack.
+static_assert(kReportAnnotationsCount
+	* (kReportAnnotationKeySize + kReportAnnotationValueSize + 2)
+	+ kReportBreadcrumbsCount * (kReportBreadcrumbSize + 26)
+	+ 16 <= kReportHeaderSizeLimit / 2);
+
+// Lock-free, may be called from any thread, too long texts are cut.
+// The values are read from the crash handler without any locks.
+void SetReportAnnotation(std::string_view key, std::string_view value);
+void AddReportBreadcrumb(std::string_view text, crl::time when);
+
+struct ReportBreadcrumb {
+	crl::time when = 0;
+	std::string text;
+};
+
+// Not async-signal-safe, for passing to the crash handler on start.
+[[nodiscard]] std::map<std::string, std::string> ReportAnnotations();
+[[nodiscard]] std::vector<ReportBreadcrumb> ReportBreadcrumbs();
+
+// Async-signal-safe, append to the header buffer.
+void WriteReportAnnotations();
+void WriteReportBreadcrumbs(crl::time now);
+
 } // namespace base::details
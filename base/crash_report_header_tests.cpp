@@ -0,0 +1,140 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/crash_report_header.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace base::details;
+
+// Values of one thread are made of a single repeated character,
+// so a torn value would mix the characters of several threads.
+[[nodiscard]] std::string ThreadValue(int thread, int iteration) {
+	return std::string(1 + (iteration % 300), char('a' + thread));
+}
+
+[[nodiscard]] bool ConsistentValue(const std::string &value, int threads) {
+	return !value.empty()
+		&& (int(value.size()) < kReportAnnotationValueSize)
+		&& (value[0] >= 'a')
+		&& (value[0] < 'a' + threads)
+		&& (value.find_first_not_of(value[0]) == std::string::npos);
+}
+
+} // namespace
+
+TEST_CASE("report annotations", "[crash_report_header]") {
+	SECTION("too long values are cut") {
+		SetReportAnnotation("test-long", std::string(4096, 'x'));
+		const auto value = ReportAnnotations()["test-long"];
+		REQUIRE(value == std::string(kReportAnnotationValueSize - 1, 'x'));
+	}
+
+	SECTION("concurrent writes of the same key") {
+		constexpr auto kThreads = 8;
+		constexpr auto kIterations = 20000;
+		auto finished = std::atomic<int>();
+		auto workers = std::vector<std::thread>();
+		for (auto thread = 0; thread != kThreads; ++thread) {
+			workers.emplace_back([&, thread] {
+				for (auto i = 0; i != kIterations; ++i) {
+					SetReportAnnotation("test-same", ThreadValue(thread, i));
+				}
+				++finished;
+			});
+		}
+		while (finished != kThreads) {
+			const auto annotations = ReportAnnotations();
+			const auto i = annotations.find("test-same");
+			if (i != end(annotations)) {
+				REQUIRE(ConsistentValue(i->second, kThreads));
+			}
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		const auto value = ReportAnnotations()["test-same"];
+		REQUIRE(ConsistentValue(value, kThreads));
+		REQUIRE(int(value.size()) == 1 + ((kIterations - 1) % 300));
+	}
+
+	SECTION("concurrent writes of different keys") {
+		constexpr auto kThreads = 8;
+		constexpr auto kKeys = 4;
+		const auto key = [](int thread, int index) {
+			return "test-key-"
+				+ std::to_string(thread)
+				+ '-'
+				+ std::to_string(index);
+		};
+		auto workers = std::vector<std::thread>();
+		for (auto thread = 0; thread != kThreads; ++thread) {
+			workers.emplace_back([&, thread] {
+				for (auto i = 0; i != 1000; ++i) {
+					for (auto index = 0; index != kKeys; ++index) {
+						SetReportAnnotation(
+							key(thread, index),
+							std::to_string(i));
+					}
+				}
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		const auto annotations = ReportAnnotations();
+		for (auto thread = 0; thread != kThreads; ++thread) {
+			for (auto index = 0; index != kKeys; ++index) {
+				const auto i = annotations.find(key(thread, index));
+				REQUIRE(i != end(annotations));
+				REQUIRE(i->second == "999");
+			}
+		}
+	}
+}
+
+TEST_CASE("report breadcrumbs", "[crash_report_header]") {
+	SECTION("the ring keeps the latest ones in order") {
+		constexpr auto kCount = 2 * kReportBreadcrumbsCount + 5;
+		for (auto i = 0; i != kCount; ++i) {
+			AddReportBreadcrumb("crumb " + std::to_string(i), i);
+		}
+		const auto breadcrumbs = ReportBreadcrumbs();
+		REQUIRE(int(breadcrumbs.size()) == kReportBreadcrumbsCount);
+		for (auto i = 0; i != kReportBreadcrumbsCount; ++i) {
+			const auto index = kCount - kReportBreadcrumbsCount + i;
+			REQUIRE(breadcrumbs[i].when == index);
+			REQUIRE(breadcrumbs[i].text == "crumb " + std::to_string(index));
+		}
+	}
+
+	SECTION("concurrent writers wrap around the ring") {
+		constexpr auto kThreads = 4;
+		auto workers = std::vector<std::thread>();
+		for (auto thread = 0; thread != kThreads; ++thread) {
+			workers.emplace_back([thread] {
+				for (auto i = 0; i != 10000; ++i) {
+					const auto when = thread * 100000 + i;
+					AddReportBreadcrumb(std::to_string(when), when);
+				}
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		const auto breadcrumbs = ReportBreadcrumbs();
+		REQUIRE(int(breadcrumbs.size()) == kReportBreadcrumbsCount);
+		for (const auto &breadcrumb : breadcrumbs) {
+			REQUIRE(breadcrumb.text == std::to_string(breadcrumb.when));
+		}
+	}
+}
@@ -9,14 +9,18 @@
 #include "base/platform/base_platform_info.h"
 #include "base/integration.h"
 #include "base/crash_report_header.h"
+#include "base/timer.h"
 
 #include <QtCore/QDir>
 #include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
 #include <QtCore/QMutex>
 #include <QtCore/QMutexLocker>
 #include <signal.h>
 #include <new>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #if !defined Q_OS_MAC || defined MAC_USE_BREAKPAD
 #define USE_BREAKPAD
@@ -65,15 +69,18 @@ using namespace ::Platform;
 } // namespace base::Platform
 
 namespace base {
+namespace details {
+
+std::atomic<crl::time> HangHeartbeat/* = 0*/;
+
+} // namespace details
+
 namespace {
 
 using namespace details;
 
 CrashReportWriter *Instance = nullptr;
 
-QMutex AnnotationsMutex;
-std::map<std::string, std::string> Annotations;
-
 int ReportFileNo = -1;
 
 std::atomic<Qt::HANDLE> ReportingThreadId = nullptr;
@@ -111,11 +118,6 @@ const char *PlatformString() {
 	Unexpected("Platform in CrashReports::PlatformString.");
 }
 
-void AddAnnotation(std::string key, std::string value) {
-	QMutexLocker lock(&AnnotationsMutex);
-	Annotations.emplace(std::move(key), std::move(value));
-}
-
 void InstallOperatorNewHandler() {
 	ReservedMemory = std::make_unique<ReservedMemoryChunk>();
 	std::set_new_handler([] {
@@ -135,7 +137,7 @@ void InstallQtMessageHandler() {
 			original(type, context, message);
 		}
 		if (type == QtFatalMsg && Instance) {
-			AddAnnotation("QtFatal", message.toStdString());
+			SetReportAnnotation("QtFatal", message.toStdString());
 			Unexpected("Qt FATAL message was generated!");
 		}
 	});
@@ -179,11 +181,9 @@ void SignalHandler(int signum, siginfo_t *info, void *ucontext) {
 	if (!ReportingHeaderWritten) {
 		ReportingHeaderWritten = true;
 
-		QMutexLocker lock(&AnnotationsMutex);
-		for (const auto &i : Annotations) {
-			ReportHeaderWriter() << i.first.c_str() << ": " << i.second.c_str() << "\n";
-		}
+		WriteReportAnnotations();
 		ReportHeaderWriter() << "\n";
+		WriteReportBreadcrumbs(crl::now());
 	}
 	if (name) {
 		ReportHeaderWriter() << "Caught signal " << signum << " (" << name << ") in thread " << uint64(thread) << "\n";
@@ -285,10 +285,101 @@ bool DumpCallback(const google_breakpad::MinidumpDescriptor &md, void *context,
 
 	return success;
 }
+
+// The hang watchdog writes its minidump through a separate handler
+// with this callback, so a real crash meanwhile still goes through
+// DumpCallback and the context tells where to put the dump name.
+struct HangDump {
+	char id[256] = { 0 };
+};
+
+#ifdef Q_OS_WIN
+bool HangDumpCallback(const wchar_t* _dump_dir, const wchar_t* _minidump_id, void* context, EXCEPTION_POINTERS* exinfo, MDRawAssertionInfo* assertion, bool success)
+#elif defined Q_OS_MAC // Q_OS_WIN
+bool HangDumpCallback(const char* _dump_dir, const char* _minidump_id, void *context, bool success)
+#else // Q_OS_MAC
+bool HangDumpCallback(const google_breakpad::MinidumpDescriptor &md, void *context, bool success)
+#endif // else for Q_OS_WIN || Q_OS_MAC
+{
+	auto &id = static_cast<HangDump*>(context)->id;
+#if defined Q_OS_WIN || defined Q_OS_MAC
+	const auto name = _minidump_id;
+#else // Q_OS_WIN || Q_OS_MAC
+	auto name = md.path();
+	for (auto ch = name; *ch != 0; ++ch) {
+		if (*ch == '/') {
+			name = (ch + 1);
+		}
+	}
+#endif // Q_OS_WIN || Q_OS_MAC
+	auto length = 0;
+	for (; name[length] != 0 && length + 1 < int(sizeof(id)); ++length) {
+		const auto ch = uint32(name[length]);
+		id[length] = (ch < 128) ? char(ch) : '?';
+	}
+	id[length] = 0;
+	return success;
+}
 #endif // USE_BREAKPAD
 
 } // namespace
 
+class CrashReportWriter::HangWatchdog final {
+public:
+	HangWatchdog(not_null<CrashReportWriter*> writer, crl::time threshold);
+	~HangWatchdog();
+
+private:
+	void run();
+
+	const not_null<CrashReportWriter*> _writer;
+	const crl::time _threshold = 0;
+	base::Timer _heartbeat;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _stopping = false;
+	std::thread _thread;
+
+};
+
+CrashReportWriter::HangWatchdog::HangWatchdog(
+	not_null<CrashReportWriter*> writer,
+	crl::time threshold)
+: _writer(writer)
+, _threshold(threshold)
+, _heartbeat([] { Heartbeat(); }) {
+	Heartbeat();
+	_heartbeat.callEach(std::max(_threshold / 4, crl::time(1)));
+	_thread = std::thread([=] { run(); });
+}
+
+CrashReportWriter::HangWatchdog::~HangWatchdog() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_one();
+	_thread.join();
+}
+
+void CrashReportWriter::HangWatchdog::run() {
+	const auto period = std::chrono::milliseconds(
+		std::max(_threshold / 4, crl::time(1)));
+	auto reported = crl::time(-1);
+	auto lock = std::unique_lock<std::mutex>(_mutex);
+	while (!_condition.wait_for(lock, period, [&] { return _stopping; })) {
+		// Report each hang once, until the heartbeat comes back.
+		const auto heartbeat = HangHeartbeat.load(std::memory_order_relaxed);
+		const auto stalled = crl::now() - heartbeat;
+		if (stalled > _threshold && heartbeat != reported) {
+			reported = heartbeat;
+			lock.unlock();
+			_writer->writeHangReport(stalled);
+			lock.lock();
+		}
+	}
+}
+
 CrashReportWriter::CrashReportWriter(const QString &path) : _path(path) {
 	Expects(Instance == nullptr);
 	Expects(_path.endsWith('/'));
@@ -300,6 +391,7 @@ CrashReportWriter::CrashReportWriter(const QString &path) : _path(path) {
 CrashReportWriter::~CrashReportWriter() {
 	Expects(Instance == this);
 
+	_hangWatchdog = nullptr;
 	finishCatching();
 	closeReport();
 
@@ -307,12 +399,12 @@ CrashReportWriter::~CrashReportWriter() {
 }
 
 void CrashReportWriter::start() {
-	AddAnnotation(
+	SetReportAnnotation(
 		"Launched",
 		QDateTime::currentDateTime().toString(
 			"dd.MM.yyyy hh:mm:ss"
 		).toStdString());
-	AddAnnotation("Platform", PlatformString());
+	SetReportAnnotation("Platform", PlatformString());
 
 	QDir().mkpath(_path);
 
@@ -419,7 +511,7 @@ void CrashReportWriter::startCatching() {
 			base::FilePath(database),
 			{}, // metrics_dir
 			std::string(), // url
-			Annotations,
+			ReportAnnotations(),
 			std::vector<std::string>(), // arguments
 			false, // restartable
 			false)) { // asynchronous_start
@@ -443,8 +535,75 @@ void CrashReportWriter::finishCatching() {
 #endif // USE_BREAKPAD
 }
 
+void CrashReportWriter::startHangWatchdog(crl::time threshold) {
+	Expects(threshold > 0);
+
+	_hangWatchdog = nullptr;
+	_hangWatchdog = std::make_unique<HangWatchdog>(this, threshold);
+}
+
+void CrashReportWriter::writeHangReport(crl::time duration) {
+	auto dump = QString();
+#ifdef USE_BREAKPAD
+	if (BreakpadExceptionHandler) {
+		auto hangDump = HangDump();
+		const auto written = google_breakpad::ExceptionHandler::WriteMinidump(
+#ifdef Q_OS_WIN
+			_path.toStdWString(),
+#else // Q_OS_WIN
+			QFile::encodeName(_path).toStdString(),
+#endif // Q_OS_WIN
+			HangDumpCallback,
+			&hangDump);
+		if (written) {
+			dump = QString::fromUtf8(hangDump.id);
+		}
+	}
+#endif // USE_BREAKPAD
+
+	auto text = QByteArray();
+	for (const auto &[key, value] : ReportAnnotations()) {
+		text.append(key.c_str()).append(": ").append(value.c_str());
+		text.append('\n');
+	}
+	text.append('\n');
+	const auto now = crl::now();
+	const auto breadcrumbs = ReportBreadcrumbs();
+	if (!breadcrumbs.empty()) {
+		text.append("Breadcrumbs:\n");
+		for (const auto &breadcrumb : breadcrumbs) {
+			text.append('-').append(QByteArray::number(now - breadcrumb.when));
+			text.append(" ms: ").append(breadcrumb.text.c_str()).append('\n');
+		}
+		text.append('\n');
+	}
+	text.append("Hang detected, no heartbeat for ");
+	text.append(QByteArray::number(duration)).append(" ms\n");
+	if (!dump.isEmpty()) {
+		text.append("Minidump: ").append(dump.toUtf8()).append('\n');
+	}
+
+	auto file = QFile(_path
+		+ "hang_"
+		+ QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss")
+		+ ".txt");
+	if (file.open(QIODevice::WriteOnly)) {
+		file.write(text);
+	}
+}
+
 void CrashReportWriter::addAnnotation(std::string key, std::string value) {
-	AddAnnotation(std::move(key), std::move(value));
+	SetAnnotation(key, value);
+}
+
+void CrashReportWriter::SetAnnotation(
+		std::string_view key,
+		std::string_view value) {
+	SetReportAnnotation(key, value);
+}
+
+void CrashReportWriter::AddBreadcrumb(std::string_view text) {
+	AddReportBreadcrumb(text, crl::now());
 }
 
 QString CrashReportWriter::reportPath() const {
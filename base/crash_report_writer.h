@@ -8,7 +8,14 @@
 
 #include "base/file_lock.h"
 
+#include <atomic>
+
 namespace base {
+namespace details {
+
+extern std::atomic<crl::time> HangHeartbeat;
+
+} // namespace details
 
 class CrashReportWriter final {
 public:
@@ -19,19 +26,37 @@ public:
 
 	void addAnnotation(std::string key, std::string value);
 
+	// Lock-free and cheap, may be called from any thread at any time.
+	// Both end up in the header of the report if the app crashes.
+	static void SetAnnotation(std::string_view key, std::string_view value);
+	static void AddBreadcrumb(std::string_view text);
+
+	// When the thread calling this doesn't call Heartbeat() for longer
+	// than the threshold a minidump of all threads and the annotations
+	// are written beside the crash report. Heartbeat() is also called
+	// by a timer, so a spinning event loop of that thread is enough.
+	void startHangWatchdog(crl::time threshold);
+	static void Heartbeat() {
+		details::HangHeartbeat.store(crl::now(), std::memory_order_relaxed);
+	}
+
 private:
+	class HangWatchdog;
+
 	[[nodiscard]] QString reportPath() const;
 	[[nodiscard]] std::optional<QByteArray> readPreviousReport();
 	bool openReport();
 	void closeReport();
 	void startCatching();
 	void finishCatching();
+	void writeHangReport(crl::time duration);
 
 	const QString _path;
 	FileLock _reportLock;
 	QFile _reportFile;
 	std::optional<QByteArray> _previousReport;
 	std::map<std::string, std::string> _annotations;
+	std::unique_ptr<HangWatchdog> _hangWatchdog;
 
 };
 
@@ -8,10 +8,255 @@
 
 #include "base/integration.h"
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace base {
+namespace {
 
-void LogWriteMain(const QString &message) {
+constexpr auto kFlushDelay = std::chrono::milliseconds(100);
+
+// Single producer (the owning thread), single consumer (the writer).
+class LogRing final {
+public:
+	static constexpr auto kSize = uint32(1024);
+
+	struct Entry {
+		uint64 sequence = 0;
+		LogRecord record;
+	};
+
+	// Returns the amount of entries queued after this one, or -1.
+	int push(Entry &&entry) {
+		const auto head = _head.load(std::memory_order_relaxed);
+		const auto tail = _tail.load(std::memory_order_acquire);
+		if (head - tail == kSize) {
+			return -1;
+		}
+		_entries[head % kSize] = std::move(entry);
+		_head.store(head + 1, std::memory_order_release);
+		return int(head + 1 - tail);
+	}
+
+	template <typename Callback>
+	void drain(Callback &&callback) {
+		const auto tail = _tail.load(std::memory_order_relaxed);
+		const auto head = _head.load(std::memory_order_acquire);
+		for (auto i = tail; i != head; ++i) {
+			callback(std::exchange(_entries[i % kSize], Entry()));
+		}
+		_tail.store(head, std::memory_order_release);
+	}
+
+	void detach() {
+		_detached.store(true, std::memory_order_release);
+	}
+	[[nodiscard]] bool detached() const {
+		return _detached.load(std::memory_order_acquire);
+	}
+
+private:
+	std::array<Entry, kSize> _entries;
+	alignas(64) std::atomic<uint32> _head = 0;
+	alignas(64) std::atomic<uint32> _tail = 0;
+	std::atomic<bool> _detached = false;
+
+};
+
+class LogWriter final {
+public:
+	LogWriter();
+	~LogWriter();
+
+	void push(LogRecord &&record);
+	void stop();
+
+private:
+	[[nodiscard]] not_null<LogRing*> ring();
+	void wakeUp();
+	void run();
+	void write();
+
+	const uint64 _id = 0;
+	std::atomic<uint64> _sequence = 0;
+	std::atomic<bool> _wakeUp = false;
+	std::mutex _mutex;
+	std::mutex _writeMutex; // There is a single consumer of each ring.
+	std::condition_variable _condition;
+	std::vector<std::shared_ptr<LogRing>> _rings;
+	std::vector<LogRing::Entry> _batch;
+	std::vector<LogRecord> _records;
+	bool _stopping = false;
+	std::atomic<bool> _stopped = false;
+	std::thread _thread;
+
+};
+
+std::atomic<LogWriter*> AsyncWriter/* = nullptr*/;
+std::atomic<uint64> AsyncWriterId/* = 0*/;
+
+struct LogRingHolder {
+	~LogRingHolder() {
+		if (ring) {
+			ring->detach();
+		}
+	}
+
+	uint64 writerId = 0;
+	std::shared_ptr<LogRing> ring;
+};
+
+thread_local LogRingHolder CurrentRing;
+thread_local bool InsideWrite/* = false*/;
+
+void WriteNow(LogRecord &&record) {
+	auto records = std::array<LogRecord, 1>{ std::move(record) };
+	if (Integration::Exists()) {
+		Integration::Instance().logMessages(records);
+	}
+}
+
+LogWriter::LogWriter()
+: _id(++AsyncWriterId)
+, _thread([=] { run(); }) {
+}
+
+LogWriter::~LogWriter() {
+	stop();
+}
+
+void LogWriter::stop() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_stopping) {
+			return;
+		}
+		_stopping = true;
+	}
+	_condition.notify_one();
+	_thread.join();
+	_stopped.store(true);
+
+	// Records pushed while the thread was finishing. Records pushed
+	// after this drain are written by the pushing threads, see push().
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	write();
+}
+
+not_null<LogRing*> LogWriter::ring() {
+	auto &holder = CurrentRing;
+	if (holder.writerId != _id) {
+		if (holder.ring) {
+			holder.ring->detach();
+		}
+		holder.writerId = _id;
+		holder.ring = std::make_shared<LogRing>();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_rings.push_back(holder.ring);
+	}
+	return holder.ring.get();
+}
+
+void LogWriter::push(LogRecord &&record) {
+	if (InsideWrite || _stopped.load(std::memory_order_acquire)) {
+		// Logging from inside Integration::logMessages() or after stop().
+		WriteNow(std::move(record));
+		return;
+	}
+	const auto ring = this->ring();
+	auto entry = LogRing::Entry{
+		.sequence = _sequence.fetch_add(1, std::memory_order_relaxed),
+		.record = std::move(record),
+	};
+	auto queued = ring->push(std::move(entry));
+	while (queued < 0) {
+		// Don't lose records, wait for the writer to make some room.
+		if (_stopped.load(std::memory_order_acquire)) {
+			write();
+		} else {
+			wakeUp();
+			std::this_thread::yield();
+		}
+		queued = ring->push(std::move(entry));
+	}
+
+	// If stop() has drained the rings already nobody else will.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (_stopped.load(std::memory_order_relaxed)) {
+		write();
+	} else if (queued == LogRing::kSize / 2) {
+		wakeUp();
+	}
+}
+
+void LogWriter::wakeUp() {
+	if (!_wakeUp.exchange(true, std::memory_order_acq_rel)) {
+		_condition.notify_one();
+	}
+}
+
+void LogWriter::run() {
+	auto lock = std::unique_lock<std::mutex>(_mutex);
+	while (true) {
+		_condition.wait_for(lock, kFlushDelay, [&] {
+			return _stopping || _wakeUp.load(std::memory_order_acquire);
+		});
+		_wakeUp.store(false, std::memory_order_release);
+		const auto stopping = _stopping;
+		lock.unlock();
+		write();
+		lock.lock();
+		if (stopping) {
+			break;
+		}
+	}
+}
+
+void LogWriter::write() {
+	std::lock_guard<std::mutex> guard(_writeMutex);
+	auto rings = std::vector<std::shared_ptr<LogRing>>();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		rings = _rings;
+	}
+	for (const auto &ring : rings) {
+		// Check before draining so that nothing pushed before detach is lost.
+		const auto detached = ring->detached();
+		ring->drain([&](LogRing::Entry &&entry) {
+			_batch.push_back(std::move(entry));
+		});
+		if (detached) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_rings.erase(ranges::remove(_rings, ring), end(_rings));
+		}
+	}
+	if (_batch.empty()) {
+		return;
+	}
+	ranges::sort(_batch, std::less<>(), &LogRing::Entry::sequence);
+	_records.reserve(_batch.size());
+	for (auto &entry : _batch) {
+		_records.push_back(std::move(entry.record));
+	}
+	_batch.clear();
 	if (Integration::Exists()) {
+		InsideWrite = true;
+		Integration::Instance().logMessages(_records);
+		InsideWrite = false;
+	}
+	_records.clear();
+}
+
+} // namespace
+
+void LogWriteMain(const QString &message) {
+	if (const auto writer = AsyncWriter.load(std::memory_order_acquire)) {
+		writer->push({ .message = message, .when = crl::now() });
+	} else if (Integration::Exists()) {
 		Integration::Instance().logMessage(message);
 	}
 }
@@ -19,10 +264,17 @@ void LogWriteMain(const QString &message) {
 void LogWriteDebug(const QString &message, const char *file, int line) {
 	Expects(!LogSkipDebug());
 
-	Integration::Instance().logMessageDebug(QString("%1 (%2 : %3)").arg(
-		message,
-		QString::fromUtf8(file),
-		QString::number(__LINE__)));
+	auto record = LogRecord{
+		.message = message,
+		.file = file,
+		.line = line,
+	};
+	if (const auto writer = AsyncWriter.load(std::memory_order_acquire)) {
+		record.when = crl::now();
+		writer->push(std::move(record));
+	} else {
+		Integration::Instance().logMessageDebug(LogDebugText(record));
+	}
 }
 
 bool LogSkipDebug() {
@@ -34,4 +286,88 @@ QString LogProfilePrefix() {
 	return '[' + QString::number(now / 1000., 'f', 3) + "] ";
 }
 
+QString LogDebugText(const LogRecord &record) {
+	return QString("%1 (%2 : %3)").arg(
+		record.message,
+		QString::fromUtf8(record.file),
+		QString::number(record.line));
+}
+
+namespace details {
+
+int64 LogSite::everyN(uint32 n) {
+	const auto index = _counter.fetch_add(1, std::memory_order_relaxed);
+	return (n <= 1)
+		? 0
+		: (index % n)
+		? -1
+		: index
+		? int64(n - 1)
+		: 0;
+}
+
+int64 LogSite::firstN(uint32 n) {
+	const auto index = _counter.fetch_add(1, std::memory_order_relaxed);
+	if (index < n) {
+		return 0;
+	}
+	// Report 1, 2, 4, 8, ... suppressed messages.
+	const auto suppressed = index - n + 1;
+	return (suppressed & (suppressed - 1)) ? -1 : int64(suppressed);
+}
+
+int64 LogSite::rateLimited(uint32 perSecond) {
+	// Approximate under contention, it is enough for limiting the log.
+	const auto window = crl::now() / 1000;
+	auto was = _window.load(std::memory_order_relaxed);
+	if (was != window
+		&& _window.compare_exchange_strong(
+			was,
+			window,
+			std::memory_order_relaxed)) {
+		_counter.store(1, std::memory_order_relaxed);
+		return int64(_suppressed.exchange(0, std::memory_order_relaxed));
+	} else if (_counter.fetch_add(1, std::memory_order_relaxed) < perSecond) {
+		return 0;
+	}
+	_suppressed.fetch_add(1, std::memory_order_relaxed);
+	return -1;
+}
+
+void LogWriteSuppressed(int64 count, const char *file, int line) {
+	if (count > 0) {
+		LogWriteMain(QString("Suppressed %1 messages (%2 : %3)").arg(
+			QString::number(count),
+			QString::fromUtf8(file),
+			QString::number(line)));
+	}
+}
+
+} // namespace details
+
+void LogStartAsync() {
+	if (AsyncWriter.load(std::memory_order_acquire)) {
+		return;
+	}
+	const auto created = new LogWriter();
+	auto expected = (LogWriter*)nullptr;
+	if (!AsyncWriter.compare_exchange_strong(
+			expected,
+			created,
+			std::memory_order_acq_rel)) {
+		delete created;
+	}
+}
+
+void LogStopAsync() {
+	// Other threads may still be inside push() of the stopped writer,
+	// so it is never freed. Afterwards it writes records synchronously,
+	// only the ones pushed right during the final drain may be lost.
+	if (const auto writer = AsyncWriter.exchange(
+			nullptr,
+			std::memory_order_acq_rel)) {
+		writer->stop();
+	}
+}
+
 } // namespace base
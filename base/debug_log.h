@@ -9,15 +9,54 @@
 #include "base/assertion.h" // SOURCE_FILE_BASENAME
 
 #include <QtCore/QString>
+#include <crl/crl_time.h>
+
+#include <atomic>
 
 namespace base {
 
+struct LogRecord {
+	QString message;
+	const char *file = nullptr; // Only for DEBUG_LOG() records.
+	int line = 0;
+	crl::time when = 0;
+};
+
 void LogWriteMain(const QString &message);
 void LogWriteDebug(const QString &message, const char *file, int line);
 [[nodiscard]] bool LogSkipDebug();
 
 [[nodiscard]] QString LogProfilePrefix();
+[[nodiscard]] QString LogDebugText(const LogRecord &record);
+
+// After LogStartAsync() the LOG() / DEBUG_LOG() calls only put records
+// to the per-thread queues, a background thread passes them in batches
+// to Integration::logMessages(). LogStopAsync() writes all that's left.
+void LogStartAsync();
+void LogStopAsync();
+
+namespace details {
+
+// Counters of a single LOG_EVERY_N / LOG_FIRST_N / LOG_RATE_LIMITED site.
+class LogSite final {
+public:
+	// -1 to skip, otherwise log with the suppressed count before it.
+	[[nodiscard]] int64 everyN(uint32 n);
+	[[nodiscard]] int64 rateLimited(uint32 perSecond);
+
+	// 0 to log, -1 to skip, otherwise only log the suppressed count.
+	[[nodiscard]] int64 firstN(uint32 n);
+
+private:
+	std::atomic<uint64> _counter = 0;
+	std::atomic<uint64> _suppressed = 0;
+	std::atomic<crl::time> _window = 0;
+
+};
+
+void LogWriteSuppressed(int64 count, const char *file, int line);
 
+} // namespace details
 } // namespace base
 
 #define LOG(message) (::base::LogWriteMain(QString message))
@@ -36,3 +75,41 @@ void LogWriteDebug(const QString &message, const char *file, int line);
 	}\
 }
 //usage DEBUG_LOG(("log: %1 %2").arg(1).arg(2))
+
+#define LOG_EVERY_N(n, message) {\
+	static ::base::details::LogSite LogSiteCounters;\
+	if (const auto suppressed = LogSiteCounters.everyN(n); suppressed >= 0) {\
+		::base::details::LogWriteSuppressed(\
+			suppressed,\
+			SOURCE_FILE_BASENAME,\
+			__LINE__);\
+		LOG(message);\
+	}\
+}
+//usage LOG_EVERY_N(100, ("log: %1 %2").arg(1).arg(2))
+
+#define LOG_FIRST_N(n, message) {\
+	static ::base::details::LogSite LogSiteCounters;\
+	if (const auto suppressed = LogSiteCounters.firstN(n); !suppressed) {\
+		LOG(message);\
+	} else if (suppressed > 0) {\
+		::base::details::LogWriteSuppressed(\
+			suppressed,\
+			SOURCE_FILE_BASENAME,\
+			__LINE__);\
+	}\
+}
+//usage LOG_FIRST_N(10, ("log: %1 %2").arg(1).arg(2))
+
+#define LOG_RATE_LIMITED(per_second, message) {\
+	static ::base::details::LogSite LogSiteCounters;\
+	if (const auto suppressed = LogSiteCounters.rateLimited(per_second)\
+		; suppressed >= 0) {\
+		::base::details::LogWriteSuppressed(\
+			suppressed,\
+			SOURCE_FILE_BASENAME,\
+			__LINE__);\
+		LOG(message);\
+	}\
+}
+//usage LOG_RATE_LIMITED(5, ("log: %1 %2").arg(1).arg(2))
@@ -49,6 +49,24 @@ Integration::Integration(int argc, char *argv[]) {
 	_executableName = info.fileName();
 }
 
+void Integration::logMessageDebugAt(const QString &message, crl::time when) {
+	logMessageDebug(message);
+}
+
+void Integration::logMessageAt(const QString &message, crl::time when) {
+	logMessage(message);
+}
+
+void Integration::logMessages(gsl::span<const LogRecord> records) {
+	for (const auto &record : records) {
+		if (record.file) {
+			logMessageDebugAt(LogDebugText(record), record.when);
+		} else {
+			logMessageAt(record.message, record.when);
+		}
+	}
+}
+
 void Integration::logAssertionViolation(const QString &info) {
 	logMessage("Assertion Failed! " + info);
 }
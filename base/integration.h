@@ -8,8 +8,12 @@
 
 #include "base/basic_types.h"
 
+#include <crl/crl_time.h>
+
 namespace base {
 
+struct LogRecord;
+
 class Integration {
 public:
 	static void Set(not_null<Integration*> instance);
@@ -23,6 +27,12 @@ public:
 	virtual bool logSkipDebug() = 0;
 	virtual void logMessageDebug(const QString &message) = 0;
 	virtual void logMessage(const QString &message) = 0;
+
+	// Records written asynchronously, with their crl::now() capture time.
+	// By default the capture time is ignored.
+	virtual void logMessageDebugAt(const QString &message, crl::time when);
+	virtual void logMessageAt(const QString &message, crl::time when);
+	virtual void logMessages(gsl::span<const LogRecord> records);
 	virtual void logAssertionViolation(const QString &info);
 	virtual void setCrashAnnotation(
 		const std::string &key,
@@ -6,7 +6,9 @@
 //
 #include "base/options.h"
 
+#include "base/atomic_file_writer.h"
 #include "base/call_delayed.h"
+#include "base/flat_set.h"
 #include "base/variant.h"
 #include "base/debug_log.h"
 
@@ -21,7 +23,34 @@ namespace {
 
 constexpr auto kSaveDelay = crl::time(1000);
 
+// Binary format: [magic : 4][version : 4] and a sequence of records
+// [size : 4][type : 1][id size : 2][id][value][checksum : 4].
+// Changes are appended, the latest record for an id wins, the file
+// is rewritten with only the current values when it grows too much.
+// It is kept next to the json file of the older versions.
+constexpr auto kJsonExtension = ".json";
+constexpr auto kBinaryExtension = ".bin";
+constexpr auto kBinaryMagic = std::array<char, 4>{ { 'T', 'D', 'O', 'P' } };
+constexpr auto kBinaryVersion = uint32(1);
+constexpr auto kBinaryHeaderSize = 8;
+constexpr auto kMaxRecordSize = 1024 * 1024;
+constexpr auto kCompactThreshold = 4096;
+
+enum class RecordType : uchar {
+	Reset,
+	Bool,
+	Int,
+	String,
+};
+
+struct StoreState {
+	bool binary = false;
+	qint64 size = 0;
+	qint64 compactedSize = 0;
+};
+
 bool WriteScheduled/* = false*/;
+StoreState State;
 
 struct Compare {
 	bool operator()(const char *a, const char *b) const noexcept {
@@ -40,6 +69,200 @@ using MapType = base::flat_map<const char*, not_null<BasicOption*>, Compare>;
 	return result;
 }
 
+[[nodiscard]] base::flat_set<not_null<BasicOption*>> &Pending() {
+	static auto result = base::flat_set<not_null<BasicOption*>>();
+	return result;
+}
+
+void AppendUInt32(QByteArray &to, uint32 value) {
+	for (auto i = 0; i != 4; ++i) {
+		to.append(char((value >> (i * 8)) & 0xFF));
+	}
+}
+
+[[nodiscard]] uint32 ReadUInt32(const uchar *data) {
+	return uint32(data[0])
+		| (uint32(data[1]) << 8)
+		| (uint32(data[2]) << 16)
+		| (uint32(data[3]) << 24);
+}
+
+[[nodiscard]] uint32 Checksum(const char *data, int size) {
+	auto result = uint32(2166136261U);
+	for (auto i = 0; i != size; ++i) {
+		result = (result ^ uchar(data[i])) * uint32(16777619U);
+	}
+	return result;
+}
+
+void AppendRecord(QByteArray &to, not_null<BasicOption*> option) {
+	auto body = QByteArray();
+	const auto &value = option->value();
+	const auto type = (value == option->defaultValue())
+		? RecordType::Reset
+		: v::match(value, [](const auto &current) {
+			using T = std::remove_cvref_t<decltype(current)>;
+			if constexpr (std::is_same_v<T, bool>) {
+				return RecordType::Bool;
+			} else if constexpr (std::is_same_v<T, int>) {
+				return RecordType::Int;
+			} else if constexpr (std::is_same_v<T, QString>) {
+				return RecordType::String;
+			} else {
+				static_assert(unsupported_type(T()));
+			}
+		});
+	const auto id = option->id().toLatin1();
+	body.append(char(type));
+	body.append(char(id.size() & 0xFF));
+	body.append(char((id.size() >> 8) & 0xFF));
+	body.append(id);
+	switch (type) {
+	case RecordType::Bool:
+		body.append(v::get<bool>(value) ? char(1) : char(0));
+		break;
+	case RecordType::Int:
+		AppendUInt32(body, uint32(v::get<int>(value)));
+		break;
+	case RecordType::String: {
+		const auto utf8 = v::get<QString>(value).toUtf8();
+		AppendUInt32(body, uint32(utf8.size()));
+		body.append(utf8);
+	} break;
+	case RecordType::Reset:
+		break;
+	}
+	AppendUInt32(to, uint32(body.size()));
+	to.append(body);
+	AppendUInt32(to, Checksum(body.constData(), body.size()));
+}
+
+[[nodiscard]] QString BinaryPath(const QString &jsonPath) {
+	const auto extension = QString(kJsonExtension);
+	return (jsonPath.endsWith(extension)
+		? jsonPath.mid(0, jsonPath.size() - extension.size())
+		: jsonPath) + kBinaryExtension;
+}
+
+[[nodiscard]] QByteArray SerializeBinary() {
+	// Even without values the file marks that json was migrated.
+	auto result = QByteArray(kBinaryMagic.data(), kBinaryMagic.size());
+	AppendUInt32(result, kBinaryVersion);
+	for (const auto &[name, option] : Map()) {
+		if (option->value() != option->defaultValue()) {
+			AppendRecord(result, option);
+		}
+	}
+	return result;
+}
+
+[[nodiscard]] bool IsBinary(const QByteArray &bytes) {
+	return (bytes.size() >= kBinaryHeaderSize)
+		&& !memcmp(bytes.constData(), kBinaryMagic.data(), kBinaryMagic.size());
+}
+
+[[nodiscard]] std::optional<ValueType> ReadRecordValue(
+		RecordType type,
+		const uchar *data,
+		int size) {
+	switch (type) {
+	case RecordType::Bool:
+		if (size == 1) {
+			return (data[0] != 0);
+		}
+		break;
+	case RecordType::Int:
+		if (size == 4) {
+			return int(ReadUInt32(data));
+		}
+		break;
+	case RecordType::String:
+		if (size >= 4 && ReadUInt32(data) == uint32(size - 4)) {
+			return QString::fromUtf8(
+				reinterpret_cast<const char*>(data + 4),
+				size - 4);
+		}
+		break;
+	case RecordType::Reset:
+		break;
+	}
+	return std::nullopt;
+}
+
+void ApplyRecord(const QString &path, const uchar *body, int size) {
+	const auto type = RecordType(body[0]);
+	const auto idSize = int(body[1]) | (int(body[2]) << 8);
+	if (type > RecordType::String || 3 + idSize > size) {
+		LOG(("Experimental: Bad record in '%1'.").arg(path));
+		return;
+	}
+	const auto id = QByteArray(
+		reinterpret_cast<const char*>(body + 3),
+		idSize);
+	auto &map = Map();
+	const auto i = map.find(id.constData());
+	if (i == end(map)) {
+		LOG(("Experimental: Unknown option '%1'."
+			).arg(QString::fromLatin1(id)));
+		return;
+	}
+	const auto option = i->second;
+	if (type == RecordType::Reset) {
+		option->set(option->defaultValue());
+		return;
+	}
+	auto value = ReadRecordValue(
+		type,
+		body + 3 + idSize,
+		size - 3 - idSize);
+	if (!value || value->index() != option->value().index()) {
+		LOG(("Experimental: Wrong option value type for '%1'."
+			).arg(QString::fromLatin1(id)));
+		return;
+	}
+	option->set(std::move(*value));
+}
+
+void ReadBinary(const QString &path, const QByteArray &bytes) {
+	const auto data = reinterpret_cast<const uchar*>(bytes.constData());
+	const auto size = qint64(bytes.size());
+	if (ReadUInt32(data + kBinaryMagic.size()) != kBinaryVersion) {
+		LOG(("Experimental: Unsupported version of '%1'.").arg(path));
+		return;
+	}
+	auto offset = qint64(kBinaryHeaderSize);
+	while (offset + 4 <= size) {
+		const auto bodySize = qint64(ReadUInt32(data + offset));
+		if (bodySize < 3
+			|| bodySize > kMaxRecordSize
+			|| offset + 4 + bodySize + 4 > size) {
+			break;
+		}
+		const auto body = data + offset + 4;
+		const auto checksum = ReadUInt32(body + bodySize);
+		if (checksum != Checksum(
+				reinterpret_cast<const char*>(body),
+				int(bodySize))) {
+			break;
+		}
+		ApplyRecord(path, body, int(bodySize));
+		offset += 4 + bodySize + 4;
+	}
+	if (offset != size) {
+		// Interrupted append, the next write will compact the file.
+		LOG(("Experimental: Bad tail in '%1', %2 of %3 bytes read."
+			).arg(path
+			).arg(offset
+			).arg(size));
+		return;
+	}
+	State = StoreState{
+		.binary = true,
+		.size = size,
+		.compactedSize = size,
+	};
+}
+
 [[nodiscard]] QJsonObject Serialize() {
 	auto result = QJsonObject();
 	for (const auto &[name, option] : Map()) {
@@ -60,16 +283,9 @@ using MapType = base::flat_map<const char*, not_null<BasicOption*>, Compare>;
 	return result;
 }
 
-void Read(const QString &path) {
-	auto file = QFile(path);
-	if (!file.exists()) {
-		return;
-	} else if (!file.open(QIODevice::ReadOnly)) {
-		LOG(("Experimental: Error opening file from '%1'.").arg(path));
-		return;
-	}
+void ReadJson(const QString &path, const QByteArray &bytes) {
 	auto error = QJsonParseError();
-	const auto parsed = QJsonDocument::fromJson(file.readAll(), &error);
+	const auto parsed = QJsonDocument::fromJson(bytes, &error);
 	if (error.error != QJsonParseError::NoError) {
 		LOG(("Experimental: Error parsing json from '%1': %2 (%3)"
 			).arg(path
@@ -116,6 +332,60 @@ void Read(const QString &path) {
 	}
 }
 
+void Read(const QString &path) {
+	auto file = QFile(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		LOG(("Experimental: Error opening file from '%1'.").arg(path));
+		return;
+	}
+	const auto size = file.size();
+	const auto mapped = (size > 0 && size <= INT_MAX)
+		? file.map(0, size)
+		: nullptr;
+	const auto bytes = mapped
+		? QByteArray::fromRawData(
+			reinterpret_cast<const char*>(mapped),
+			int(size))
+		: file.readAll();
+	if (IsBinary(bytes)) {
+		ReadBinary(path, bytes);
+	} else if (path.endsWith(kJsonExtension)) {
+		ReadJson(path, bytes);
+	} else {
+		// The next write will rewrite the file.
+		LOG(("Experimental: Bad header in '%1'.").arg(path));
+	}
+}
+
+void Compact(const QString &path) {
+	State = StoreState();
+	const auto bytes = SerializeBinary();
+	auto file = AtomicFileWriter(path, { .preallocate = bytes.size() });
+	if (!file.write(bytes) || !file.commit()) {
+		LOG(("Experimental: Could not write '%1'.").arg(path));
+		return;
+	}
+	State = StoreState{
+		.binary = true,
+		.size = bytes.size(),
+		.compactedSize = bytes.size(),
+	};
+}
+
+[[nodiscard]] bool Append(const QString &path, const QByteArray &records) {
+	auto file = QFile(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append)
+		|| file.size() != State.size) {
+		return false;
+	} else if (file.write(records) != records.size() || !file.flush()) {
+		// Make sure a partially written record gets rewritten.
+		State.binary = false;
+		return false;
+	}
+	State.size += records.size();
+	return true;
+}
+
 void Write() {
 	const auto &path = LocalPath();
 	if (!WriteScheduled || path.isEmpty()) {
@@ -123,13 +393,21 @@ void Write() {
 	}
 	WriteScheduled = false;
 
-	const auto map = Serialize();
-	if (map.isEmpty()) {
-		QFile(path).remove();
-	} else if (auto file = QFile(path); file.open(QIODevice::WriteOnly)) {
-		file.write(QJsonDocument(map).toJson(QJsonDocument::Indented));
-	} else {
-		LOG(("Experimental: Could not write '%1'.").arg(path));
+	const auto pending = base::take(Pending());
+	if (!State.binary) {
+		Compact(path);
+		return;
+	} else if (pending.empty()) {
+		return;
+	}
+	auto records = QByteArray();
+	for (const auto &option : pending) {
+		AppendRecord(records, option);
+	}
+	const auto appended = State.size - State.compactedSize + records.size();
+	const auto limit = std::max(State.compactedSize, qint64(kCompactThreshold));
+	if (appended > limit || !Append(path, records)) {
+		Compact(path);
 	}
 }
 
@@ -152,6 +430,13 @@ BasicOption::BasicOption(
 	const auto [i, ok] = Map().emplace(id, this);
 
 	Ensures(ok);
+
+	_slot = v::match(_value, [](const auto &value) {
+		using T = std::remove_cvref_t<decltype(value)>;
+		auto &slots = Slots<T>();
+		slots.push_back({ value });
+		return int(slots.size()) - 1;
+	});
 }
 
 void BasicOption::set(ValueType value) {
@@ -159,7 +444,12 @@ void BasicOption::set(ValueType value) {
 
 	const auto changed = (_value != value);
 	_value = std::move(value);
+	v::match(_value, [&](const auto &value) {
+		using T = std::remove_cvref_t<decltype(value)>;
+		Slots<T>()[_slot].value = value;
+	});
 	if (changed) {
+		Pending().emplace(this);
 		_changes.fire({});
 	}
 	if (!WriteScheduled && !LocalPath().isEmpty()) {
@@ -223,6 +513,27 @@ BasicOption &Lookup(const char id[]) {
 	return *i->second;
 }
 
+void Open(const QString &path) {
+	Expects(!path.isEmpty());
+
+	LocalPath() = QString();
+	WriteScheduled = false;
+	State = StoreState();
+	reset();
+
+	const auto binary = BinaryPath(path);
+	if (QFile::exists(binary)) {
+		Read(binary);
+	} else if (QFile::exists(path)) {
+		// Older versions keep reading the json file, so it is left
+		// in place and the values are migrated from it only once.
+		Read(path);
+		Compact(binary);
+	}
+	Pending().clear();
+	LocalPath() = binary;
+}
+
 } // namespace details
 
 bool changed() {
@@ -319,13 +630,15 @@ void init(const QString &path) {
 	Expects(details::LocalPath().isEmpty());
 
 	if (!path.isEmpty()) {
-		details::Read(path);
-
-		details::LocalPath() = path;
+		details::Open(path);
 		static const auto guard = gsl::finally([] {
-			details::Write();
+			flush();
 		});
 	}
 }
 
+void flush() {
+	details::Write();
+}
+
 } // namespace base::options
@@ -12,6 +12,8 @@
 
 #include <rpl/rpl.h>
 
+#include <deque>
+
 #ifdef linux // GCC, cmon..
 #undef linux
 #endif // linux
@@ -31,6 +33,20 @@ using ScopeFlags = base::flags<ScopeFlag>;
 using ScopeFn = Fn<bool()>;
 using Scope = std::variant<ScopeFlags, ScopeFn>;
 
+// Current values are mirrored in per-type slots assigned at
+// registration. The slots never move, so option<Type> and handle<Type>
+// keep a pointer to theirs and reading the value is a single load.
+template <typename Type>
+struct Slot {
+	Type value = Type();
+};
+
+template <typename Type>
+[[nodiscard]] inline std::deque<Slot<Type>> &Slots() {
+	static auto result = std::deque<Slot<Type>>();
+	return result;
+}
+
 class BasicOption {
 public:
 	BasicOption(
@@ -57,6 +73,10 @@ public:
 
 	[[nodiscard]] bool restartRequired() const;
 
+	[[nodiscard]] int slot() const {
+		return _slot;
+	}
+
 private:
 	ValueType _value;
 	ValueType _defaultValue;
@@ -66,12 +86,17 @@ private:
 	QString _description;
 	Scope _scope;
 	bool _restartRequired = false;
+	int _slot = 0;
 	rpl::event_stream<> _changes;
 
 };
 
 [[nodiscard]] BasicOption &Lookup(const char name[]);
 
+// Resets the values and reads them from the storage next to the json
+// file at path. Separate from init() so that tests can reopen it.
+void Open(const QString &path);
+
 } // namespace details
 
 inline constexpr auto windows = details::ScopeFlag::Windows;
@@ -98,7 +123,8 @@ public:
 		fields.description,
 		std::move(fields.defaultValue),
 		fields.scope,
-		fields.restartRequired) {
+		fields.restartRequired)
+	, _current(&details::Slots<Type>()[slot()]) {
 	}
 
 	using BasicOption::id;
@@ -113,7 +139,7 @@ public:
 		BasicOption::set(std::move(value));
 	}
 	[[nodiscard]] Type value() const {
-		return v::get<Type>(BasicOption::value());
+		return _current->value;
 	}
 	[[nodiscard]] Type defaultValue() const {
 		return v::get<Type>(BasicOption::defaultValue());
@@ -124,13 +150,42 @@ public:
 
 		return static_cast<option&>(that);
 	}
+
+	[[nodiscard]] not_null<const details::Slot<Type>*> current() const {
+		return _current;
+	}
+
+private:
+	not_null<const details::Slot<Type>*> _current;
+
 };
 
 using toggle = option<bool>;
 
+// Resolves the id once, after that value() is a single load.
+// Create it after the option is registered, not in a global variable
+// of another translation unit.
+template <typename Type>
+class handle final {
+public:
+	explicit handle(const char id[])
+	: handle(option<Type>::Wrap(details::Lookup(id))) {
+	}
+	handle(const option<Type> &that) : _current(that.current()) {
+	}
+
+	[[nodiscard]] Type value() const {
+		return _current->value;
+	}
+
+private:
+	not_null<const details::Slot<Type>*> _current;
+
+};
+
 template <typename Type>
 [[nodiscard]] inline Type value(const char id[]) {
-	return v::get<Type>(details::Lookup(id).value());
+	return option<Type>::Wrap(details::Lookup(id)).value();
 }
 
 template <typename Type>
@@ -142,6 +197,12 @@ template <typename Type>
 [[nodiscard]] QString serialize();
 [[nodiscard]] bool deserialize(const QString &json);
 void reset();
+
+// The values are stored next to the json file at path,
+// which is only read once if it was written by an older version.
 void init(const QString &path);
 
+// Writes the changes right away instead of waiting for the timer.
+void flush();
+
 } // namespace base::options
@@ -0,0 +1,245 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/options.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+
+#include <array>
+#include <deque>
+#include <string>
+
+namespace {
+
+base::options::toggle TestBool({
+	.id = "test-options-bool",
+});
+
+base::options::option<int> TestInt({
+	.id = "test-options-int",
+});
+
+base::options::option<QString> TestString({
+	.id = "test-options-string",
+});
+
+// Registered after the ones above, so that the slots storage grows.
+[[nodiscard]] std::deque<base::options::option<int>> &MoreOptions() {
+	constexpr auto kCount = 1000;
+	static auto ids = [] {
+		auto result = std::array<std::string, kCount>();
+		for (auto i = 0; i != kCount; ++i) {
+			result[i] = "test-options-more-" + std::to_string(i);
+		}
+		return result;
+	}();
+	static auto result = [] {
+		auto result = std::deque<base::options::option<int>>();
+		for (const auto &id : ids) {
+			result.emplace_back(base::options::descriptor<int>{
+				.id = id.c_str(),
+				.defaultValue = -1,
+			});
+		}
+		return result;
+	}();
+	return result;
+}
+
+[[nodiscard]] QString JsonPath(const QTemporaryDir &dir) {
+	return dir.filePath(u"experimental_options.json"_q);
+}
+
+[[nodiscard]] QString BinaryPath(const QTemporaryDir &dir) {
+	return dir.filePath(u"experimental_options.bin"_q);
+}
+
+void Open(const QTemporaryDir &dir) {
+	// Changes schedule a write through base::call_delayed().
+	static auto argc = 1;
+	static char name[] = "options_tests";
+	static char *argv[] = { name, nullptr };
+	static auto application = QCoreApplication(argc, argv);
+
+	base::options::details::Open(JsonPath(dir));
+}
+
+[[nodiscard]] QByteArray ReadAll(const QString &path) {
+	auto file = QFile(path);
+	return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void WriteAll(const QString &path, const QByteArray &data) {
+	auto file = QFile(path);
+	REQUIRE(file.open(QIODevice::WriteOnly));
+	REQUIRE(file.write(data) == data.size());
+}
+
+} // namespace
+
+TEST_CASE("options changes are appended", "[options]") {
+	const auto dir = QTemporaryDir();
+	Open(dir);
+
+	TestInt.set(1);
+	base::options::flush();
+	const auto first = ReadAll(BinaryPath(dir));
+	REQUIRE(first.size() > 8);
+
+	TestBool.set(true);
+	TestInt.set(2);
+	base::options::flush();
+	const auto second = ReadAll(BinaryPath(dir));
+	REQUIRE(second.size() > first.size());
+	REQUIRE(second.startsWith(first));
+
+	Open(dir);
+	REQUIRE(TestBool.value());
+	REQUIRE(TestInt.value() == 2);
+	REQUIRE(TestString.value().isEmpty());
+
+	TestBool.set(false);
+	base::options::flush();
+	Open(dir);
+	REQUIRE(!TestBool.value());
+	REQUIRE(TestInt.value() == 2);
+}
+
+TEST_CASE("options file is compacted", "[options]") {
+	const auto dir = QTemporaryDir();
+	Open(dir);
+
+	TestBool.set(true);
+	auto compacted = false;
+	auto size = qint64();
+	for (auto i = 1; i <= 1000; ++i) {
+		TestString.set(QString::number(i));
+		base::options::flush();
+
+		const auto now = QFile(BinaryPath(dir)).size();
+		REQUIRE(now < 8192);
+		if (now < size) {
+			compacted = true;
+		}
+		size = now;
+	}
+	REQUIRE(compacted);
+
+	Open(dir);
+	REQUIRE(TestBool.value());
+	REQUIRE(TestString.value() == u"1000"_q);
+}
+
+TEST_CASE("options file with a truncated tail", "[options]") {
+	const auto dir = QTemporaryDir();
+	Open(dir);
+
+	TestBool.set(true);
+	base::options::flush();
+	TestInt.set(5);
+	base::options::flush();
+
+	auto file = QFile(BinaryPath(dir));
+	REQUIRE(file.resize(file.size() - 3));
+
+	Open(dir);
+	REQUIRE(TestBool.value());
+	REQUIRE(TestInt.value() == 0);
+
+	// The bad tail is dropped by the next write instead of appending.
+	TestString.set(u"tail"_q);
+	base::options::flush();
+	Open(dir);
+	REQUIRE(TestBool.value());
+	REQUIRE(TestInt.value() == 0);
+	REQUIRE(TestString.value() == u"tail"_q);
+}
+
+TEST_CASE("options file with a checksum mismatch", "[options]") {
+	const auto dir = QTemporaryDir();
+	Open(dir);
+
+	TestInt.set(1);
+	base::options::flush();
+	TestInt.set(2);
+	base::options::flush();
+
+	auto bytes = ReadAll(BinaryPath(dir));
+	bytes[bytes.size() - 1] = char(bytes[bytes.size() - 1] ^ 0x01);
+	WriteAll(BinaryPath(dir), bytes);
+
+	Open(dir);
+	REQUIRE(TestInt.value() == 1);
+}
+
+TEST_CASE("options are migrated from json once", "[options]") {
+	const auto dir = QTemporaryDir();
+	const auto json = R"({"test-options-int":7})"_q;
+	WriteAll(JsonPath(dir), json);
+
+	Open(dir);
+	REQUIRE(TestInt.value() == 7);
+	REQUIRE(QFile::exists(BinaryPath(dir)));
+	REQUIRE(ReadAll(JsonPath(dir)) == json);
+
+	// Older versions may still write the json file, it is ignored now.
+	WriteAll(JsonPath(dir), R"({"test-options-int":8})"_q);
+	Open(dir);
+	REQUIRE(TestInt.value() == 7);
+
+	// The binary file is used even with only the default values.
+	TestInt.set(0);
+	base::options::flush();
+	Open(dir);
+	REQUIRE(TestInt.value() == 0);
+	REQUIRE(QFile::exists(JsonPath(dir)));
+}
+
+TEST_CASE("option values stay in sync with the slots", "[options]") {
+	const auto boolHandle = base::options::handle<bool>(TestBool);
+	const auto intHandle = base::options::handle<int>("test-options-int");
+	const auto stringHandle = base::options::handle<QString>(TestString);
+
+	auto &more = MoreOptions();
+	auto handles = std::vector<base::options::handle<int>>();
+	for (const auto &option : more) {
+		handles.emplace_back(option);
+	}
+
+	TestBool.set(true);
+	TestInt.set(42);
+	TestString.set(u"value"_q);
+	REQUIRE(TestBool.value());
+	REQUIRE(boolHandle.value());
+	REQUIRE(TestInt.value() == 42);
+	REQUIRE(intHandle.value() == 42);
+	REQUIRE(base::options::value<int>("test-options-int") == 42);
+	REQUIRE(TestString.value() == u"value"_q);
+	REQUIRE(stringHandle.value() == u"value"_q);
+
+	for (auto i = 0; i != int(more.size()); ++i) {
+		REQUIRE(more[i].value() == -1);
+		more[i].set(i);
+	}
+	for (auto i = 0; i != int(more.size()); ++i) {
+		REQUIRE(more[i].value() == i);
+		REQUIRE(handles[i].value() == i);
+		const auto id = more[i].id().toLatin1();
+		REQUIRE(base::options::lookup<int>(id.constData()).value() == i);
+	}
+
+	base::options::reset();
+	REQUIRE(!boolHandle.value());
+	REQUIRE(intHandle.value() == 0);
+	REQUIRE(stringHandle.value().isEmpty());
+	for (const auto &handle : handles) {
+		REQUIRE(handle.value() == -1);
+	}
+}
@@ -6,95 +6,286 @@
 //
 #include "base/parse_helper.h"
 
+#include <bit>
+
+#if defined __SSE2__ || defined _M_X64 \
+	|| (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define BASE_PARSE_SSE2
+#include <emmintrin.h>
+#elif defined __aarch64__ || defined _M_ARM64
+#define BASE_PARSE_NEON
+#include <arm_neon.h>
+#endif
+
 namespace base {
 namespace parse {
+namespace {
+
+#if defined BASE_PARSE_SSE2 || defined BASE_PARSE_NEON
+#define BASE_PARSE_SIMD
+
+constexpr auto kBlockSize = 16;
+
+#ifdef BASE_PARSE_SSE2
+
+using Block = __m128i;
+
+[[nodiscard]] inline Block Load(const char *from) {
+	return _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+}
+
+[[nodiscard]] inline Block Equal(Block block, char ch) {
+	return _mm_cmpeq_epi8(block, _mm_set1_epi8(ch));
+}
+
+[[nodiscard]] inline Block Or(Block a, Block b) {
+	return _mm_or_si128(a, b);
+}
+
+// Both bounds are ASCII, so bytes >= 0x80 (negative here) never match.
+[[nodiscard]] inline Block InRange(Block block, char from, char till) {
+	return _mm_and_si128(
+		_mm_cmpgt_epi8(block, _mm_set1_epi8(from - 1)),
+		_mm_cmplt_epi8(block, _mm_set1_epi8(till + 1)));
+}
+
+// One bit for each byte of the block.
+[[nodiscard]] inline uint32 Mask(Block matches) {
+	return uint32(_mm_movemask_epi8(matches));
+}
+
+#else // BASE_PARSE_SSE2
+
+using Block = uint8x16_t;
+
+[[nodiscard]] inline Block Load(const char *from) {
+	return vld1q_u8(reinterpret_cast<const uint8_t*>(from));
+}
+
+[[nodiscard]] inline Block Equal(Block block, char ch) {
+	return vceqq_u8(block, vdupq_n_u8(uint8_t(ch)));
+}
+
+[[nodiscard]] inline Block Or(Block a, Block b) {
+	return vorrq_u8(a, b);
+}
+
+[[nodiscard]] inline Block InRange(Block block, char from, char till) {
+	return vandq_u8(
+		vcgeq_u8(block, vdupq_n_u8(uint8_t(from))),
+		vcleq_u8(block, vdupq_n_u8(uint8_t(till))));
+}
+
+[[nodiscard]] inline uint32 Mask(Block matches) {
+	static constexpr uint8_t kBits[] = {
+		1, 2, 4, 8, 16, 32, 64, 128,
+		1, 2, 4, 8, 16, 32, 64, 128,
+	};
+	const auto bits = vandq_u8(matches, vld1q_u8(kBits));
+	return uint32(vaddv_u8(vget_low_u8(bits)))
+		| (uint32(vaddv_u8(vget_high_u8(bits))) << 8);
+}
+
+#endif // BASE_PARSE_SSE2
+
+template <char First, char ...Other>
+[[nodiscard]] inline Block EqualAny(Block block) {
+	auto result = Equal(block, First);
+	((result = Or(result, Equal(block, Other))), ...);
+	return result;
+}
+
+#endif // BASE_PARSE_SSE2 || BASE_PARSE_NEON
+
+[[nodiscard]] inline bool IsWhitespace(char ch) {
+	return (ch == ' ') || (ch == '\n') || (ch == '\t') || (ch == '\r');
+}
+
+[[nodiscard]] inline bool IsNameChar(char ch) {
+	return (ch >= 'a' && ch <= 'z')
+		|| (ch >= 'A' && ch <= 'Z')
+		|| (ch >= '0' && ch <= '9')
+		|| (ch == '_');
+}
+
+template <char ...Chars>
+[[nodiscard]] const char *FindAny(const char *from, const char *end) {
+#ifdef BASE_PARSE_SIMD
+	for (; end - from >= kBlockSize; from += kBlockSize) {
+		if (const auto mask = Mask(EqualAny<Chars...>(Load(from)))) {
+			return from + std::countr_zero(mask);
+		}
+	}
+#endif // BASE_PARSE_SIMD
+	while (from != end && ((*from != Chars) && ...)) {
+		++from;
+	}
+	return from;
+}
+
+[[nodiscard]] const char *SkipWhitespaces(const char *from, const char *end) {
+#ifdef BASE_PARSE_SIMD
+	for (; end - from >= kBlockSize; from += kBlockSize) {
+		const auto spaces = EqualAny<' ', '\n', '\t', '\r'>(Load(from));
+		if (const auto mask = Mask(spaces) ^ 0xFFFFU) {
+			return from + std::countr_zero(mask);
+		}
+	}
+#endif // BASE_PARSE_SIMD
+	while (from != end && IsWhitespace(*from)) {
+		++from;
+	}
+	return from;
+}
+
+[[nodiscard]] const char *SkipName(const char *from, const char *end) {
+#ifdef BASE_PARSE_SIMD
+	for (; end - from >= kBlockSize; from += kBlockSize) {
+		const auto block = Load(from);
+		const auto name = Or(
+			Or(InRange(block, 'a', 'z'), InRange(block, 'A', 'Z')),
+			Or(InRange(block, '0', '9'), Equal(block, '_')));
+		if (const auto mask = Mask(name) ^ 0xFFFFU) {
+			return from + std::countr_zero(mask);
+		}
+	}
+#endif // BASE_PARSE_SIMD
+	while (from != end && IsNameChar(*from)) {
+		++from;
+	}
+	return from;
+}
+
+// Only the two previous chars are checked, as it always was.
+[[nodiscard]] inline bool Escaped(const char *begin, const char *quote) {
+	return (quote > begin)
+		&& (quote[-1] == '\\')
+		&& (quote - 1 == begin || quote[-2] != '\\');
+}
+
+} // namespace
 
 // inspired by https://github.com/sindresorhus/strip-json-comments
 QByteArray stripComments(const QByteArray &content) {
-	enum class InsideComment {
-		None,
-		SingleLine,
-		MultiLine,
-	};
-	auto insideComment = InsideComment::None;
-	auto insideString = false;
+	const auto begin = content.constData();
+	const auto end = begin + content.size();
 
-	QByteArray result;
-	auto begin = content.cbegin(), end = content.cend(), offset = begin;
-	auto feedContent = [&result, &offset, end](const char *ch) {
+	// Comments only shrink the content, so one allocation is enough.
+	auto result = QByteArray();
+	auto to = (char*)nullptr;
+	auto offset = begin;
+	const auto prepare = [&] {
+		if (!to) {
+			result = QByteArray(content.size(), Qt::Uninitialized);
+			to = result.data();
+		}
+	};
+	const auto feedContent = [&](const char *ch) {
 		if (ch > offset) {
-			if (result.isEmpty()) result.reserve(end - offset - 2);
-			result.append(offset, ch - offset);
+			prepare();
+			memcpy(to, offset, ch - offset);
+			to += (ch - offset);
 			offset = ch;
 		}
 	};
-	auto feedComment = [&result, &offset, end](const char *ch) {
+	const auto feedComment = [&](const char *ch) {
 		if (ch > offset) {
-			if (result.isEmpty()) result.reserve(end - offset - 2);
-			result.append(' ');
+			prepare();
+			*to++ = ' ';
 			offset = ch;
 		}
 	};
-	for (auto ch = offset; ch != end;) {
-		auto currentChar = *ch;
-		auto nextChar = (ch + 1 == end) ? 0 : *(ch + 1);
-
-		if (insideComment == InsideComment::None && currentChar == '"') {
-			auto escaped = ((ch > begin) && *(ch - 1) == '\\') && ((ch - 1 < begin) || *(ch - 2) != '\\');
-			if (!escaped) {
-				insideString = !insideString;
+	// A line ends either on "\r\n" or on a single "\n".
+	const auto lineEnd = [](const char *from, const char *newline) {
+		return (newline > from && newline[-1] == '\r')
+			? (newline - 1)
+			: newline;
+	};
+
+	auto unterminated = false;
+	for (auto ch = begin; !unterminated;) {
+		ch = FindAny<'"', '/'>(ch, end);
+		if (ch == end) {
+			break;
+		} else if (*ch == '"') {
+			if (!Escaped(begin, ch)) {
+				do {
+					ch = FindAny<'"'>(ch + 1, end);
+				} while (ch != end && Escaped(begin, ch));
+				if (ch == end) {
+					break;
+				}
 			}
-		}
-		if (insideString) {
 			++ch;
 			continue;
 		}
-
-		if (insideComment == InsideComment::None && currentChar == '/' && nextChar == '/') {
-			feedContent(ch);
-			insideComment = InsideComment::SingleLine;
-			ch += 2;
-		} else if (insideComment == InsideComment::SingleLine && currentChar == '\r' && nextChar == '\n') {
-			feedComment(ch);
-			ch += 2;
-			insideComment = InsideComment::None;
-		} else if (insideComment == InsideComment::SingleLine && currentChar == '\n') {
-			feedComment(ch);
-			++ch;
-			insideComment = InsideComment::None;
-		} else if (insideComment == InsideComment::None && currentChar == '/' && nextChar == '*') {
+		const auto next = (ch + 1 == end) ? 0 : ch[1];
+		if (next == '/') {
 			feedContent(ch);
-			ch += 2;
-			insideComment = InsideComment::MultiLine;
-		} else if (insideComment == InsideComment::MultiLine && currentChar == '*' && nextChar == '/') {
-			ch += 2;
-			feedComment(ch);
-			insideComment = InsideComment::None;
-		} else if (insideComment == InsideComment::MultiLine && currentChar == '\r' && nextChar == '\n') {
-			feedComment(ch);
-			ch += 2;
-			feedContent(ch);
-		} else if (insideComment == InsideComment::MultiLine && currentChar == '\n') {
-			feedComment(ch);
-			++ch;
+			const auto from = ch + 2;
+			ch = FindAny<'\n'>(from, end);
+			if (ch == end) {
+				unterminated = true;
+			} else {
+				feedComment(lineEnd(from, ch));
+				++ch;
+			}
+		} else if (next == '*') {
 			feedContent(ch);
+			for (auto from = ch + 2;;) {
+				ch = FindAny<'*', '\n'>(from, end);
+				if (ch == end) {
+					unterminated = true;
+					break;
+				} else if (*ch == '\n') {
+					feedComment(lineEnd(from, ch));
+					from = ++ch;
+					feedContent(ch);
+				} else if (ch + 1 != end && ch[1] == '/') {
+					ch += 2;
+					feedComment(ch);
+					break;
+				} else {
+					from = ++ch;
+				}
+			}
 		} else {
 			++ch;
 		}
 	}
 
-	if (insideComment == InsideComment::MultiLine) {
-		// unexpected end of content
-	}
-	if (insideComment == InsideComment::None && end > offset) {
-		if (result.isEmpty()) {
+	if (!unterminated) {
+		if (!to) {
 			return content;
-		} else {
-			result.append(offset, end - offset);
 		}
+		feedContent(end);
+	}
+	if (to) {
+		result.resize(to - result.constData());
 	}
 	return result;
 }
 
+Tokenizer::Tokenizer(const char *from, const char *end)
+: _from(from)
+, _end(end) {
+	Expects(_from <= _end);
+}
+
+Tokenizer::Tokenizer(const QByteArray &content)
+: Tokenizer(content.constData(), content.constData() + content.size()) {
+}
+
+bool Tokenizer::skipWhitespaces() {
+	_from = SkipWhitespaces(_from, _end);
+	return !atEnd();
+}
+
+QLatin1String Tokenizer::readName() {
+	const auto start = _from;
+	_from = SkipName(_from, _end);
+	return QLatin1String(start, _from - start);
+}
+
 } // namespace parse
 } // namespace base
@@ -37,5 +37,38 @@ inline QLatin1String readName(const char *&from, const char *end) {
 	return QLatin1String(start, from - start);
 }
 
+// Same rules as skipWhitespaces() and readName(),
+// but the input is scanned in 16 byte blocks where possible.
+class Tokenizer final {
+public:
+	Tokenizer(const char *from, const char *end);
+	explicit Tokenizer(const QByteArray &content);
+
+	[[nodiscard]] bool atEnd() const {
+		return (_from == _end);
+	}
+	[[nodiscard]] const char *position() const {
+		return _from;
+	}
+	[[nodiscard]] char current() const {
+		Expects(!atEnd());
+
+		return *_from;
+	}
+	void skip(int count = 1) {
+		Expects(count >= 0 && count <= _end - _from);
+
+		_from += count;
+	}
+
+	bool skipWhitespaces();
+	[[nodiscard]] QLatin1String readName();
+
+private:
+	const char *_from = nullptr;
+	const char *_end = nullptr;
+
+};
+
 } // namespace parse
 } // namespace base
@@ -0,0 +1,66 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/parse_helper.h"
+
+namespace {
+
+[[nodiscard]] QByteArray Strip(const char *content) {
+	return base::parse::stripComments(QByteArray(content));
+}
+
+} // namespace
+
+TEST_CASE("comments are stripped", "[parse]") {
+	SECTION("content without comments is returned as is") {
+		const auto content = QByteArray("{ \"a\": \"b/c\" }");
+		REQUIRE(base::parse::stripComments(content) == content);
+	}
+	SECTION("single line comments keep the line end") {
+		REQUIRE(Strip("a // b\nc") == "a  \nc");
+		REQUIRE(Strip("a // b\r\nc") == "a  \r\nc");
+		REQUIRE(Strip("a // b") == "a ");
+	}
+	SECTION("multi line comments keep the line ends") {
+		REQUIRE(Strip("a /* b */ c") == "a   c");
+		REQUIRE(Strip("a /* b\r\n\nc */ d") == "a  \r\n\n  d");
+		REQUIRE(Strip("a /* b") == "a ");
+	}
+	SECTION("comments inside strings are kept") {
+		REQUIRE(Strip("\"// a\" // b\n") == "\"// a\"  \n");
+		REQUIRE(Strip("\"\\\" /* a */\" /**/") == "\"\\\" /* a */\"  ");
+	}
+	SECTION("long content is handled in blocks") {
+		auto content = QByteArray(100, ' ');
+		content.append("/* comment */\"string // with slashes\"");
+		auto expected = QByteArray(100, ' ');
+		expected.append(" \"string // with slashes\"");
+		REQUIRE(base::parse::stripComments(content) == expected);
+	}
+}
+
+TEST_CASE("tokenizer matches the plain helpers", "[parse]") {
+	const auto content = QByteArray(
+		"  \t\r\n  first_name_that_is_rather_long\n\n"
+		"                                  second;Third_3");
+	auto tokenizer = base::parse::Tokenizer(content);
+	auto from = content.constData();
+	const auto end = from + content.size();
+	while (true) {
+		REQUIRE(tokenizer.skipWhitespaces()
+			== base::parse::skipWhitespaces(from, end));
+		REQUIRE(tokenizer.readName() == base::parse::readName(from, end));
+		REQUIRE(tokenizer.position() == from);
+		if (tokenizer.atEnd()) {
+			break;
+		} else if (tokenizer.current() == ';') {
+			tokenizer.skip();
+			++from;
+		}
+	}
+}
@@ -627,17 +627,17 @@ QString KeyName(GlobalShortcutKeyGeneric descriptor) {
 	//
 
 	// Modifiers.
-	static const auto ModifierToString = flat_map<uint64, const_string>{
-		{ XKB_KEY_Shift_L, "Shift" },
-		{ XKB_KEY_Shift_R, "Right Shift" },
-		{ XKB_KEY_Control_L, "Ctrl" },
-		{ XKB_KEY_Control_R, "Right Ctrl" },
-		{ XKB_KEY_Meta_L, "Meta" },
-		{ XKB_KEY_Meta_R, "Right Meta" },
-		{ XKB_KEY_Alt_L, "Alt" },
-		{ XKB_KEY_Alt_R, "Right Alt" },
-		{ XKB_KEY_Super_L, "Super" },
-		{ XKB_KEY_Super_R, "Right Super" },
+	static const auto ModifierToString = flat_map<uint64, interned_string>{
+		{ XKB_KEY_Shift_L, "Shift"_is },
+		{ XKB_KEY_Shift_R, "Right Shift"_is },
+		{ XKB_KEY_Control_L, "Ctrl"_is },
+		{ XKB_KEY_Control_R, "Right Ctrl"_is },
+		{ XKB_KEY_Meta_L, "Meta"_is },
+		{ XKB_KEY_Meta_R, "Right Meta"_is },
+		{ XKB_KEY_Alt_L, "Alt"_is },
+		{ XKB_KEY_Alt_R, "Right Alt"_is },
+		{ XKB_KEY_Super_L, "Super"_is },
+		{ XKB_KEY_Super_R, "Right Super"_is },
 	};
 	const auto modIt = ModifierToString.find(descriptor);
 	if (modIt != end(ModifierToString)) {
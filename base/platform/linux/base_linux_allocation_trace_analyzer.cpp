@@ -0,0 +1,587 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+// Replays a trace written by SetAllocationTracerPath() and reports
+// the live heap over time, the top allocation sizes and leak candidates.
+//
+// Usage: lib_base_allocation_trace_analyzer <trace> [--symbolize]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr auto kVersion = std::uint32_t(2);
+constexpr auto kTimelineBuckets = 40;
+constexpr auto kTopCount = 20;
+
+enum class BlockKind : std::uint8_t {
+	Maps = 1,
+	Events = 2,
+};
+
+enum class EventTag : std::uint8_t {
+	Malloc = 1,
+	Realloc = 2,
+	Free = 3,
+	Stack = 4,
+	Sampled = 5,
+};
+
+struct Event {
+	std::uint64_t time = 0;
+	std::uint64_t pointer = 0;
+	std::uint64_t size = 0;
+	std::uint64_t result = 0;
+	std::uint64_t rate = 0; // Mean sampling interval in bytes.
+	std::uint32_t thread = 0;
+	std::uint32_t stack = 0; // Index in stacks + 1.
+	EventTag tag = EventTag::Malloc;
+};
+
+struct Module {
+	std::uint64_t from = 0;
+	std::uint64_t till = 0;
+	std::uint64_t offset = 0;
+	std::string path;
+};
+
+struct Trace {
+	std::vector<Event> events;
+	std::vector<std::vector<std::uint64_t>> stacks;
+	std::map<std::vector<std::uint64_t>, std::uint32_t> stackIndices;
+	std::uint64_t sampled = 0;
+	std::vector<Module> modules;
+	bool truncated = false; // The last block was cut by a crash.
+};
+
+class Reader final {
+public:
+	Reader(const std::uint8_t *data, std::size_t size)
+	: _data(data)
+	, _size(size) {
+	}
+
+	[[nodiscard]] bool failed() const {
+		return _failed;
+	}
+	[[nodiscard]] bool atEnd() const {
+		return (_position == _size);
+	}
+	[[nodiscard]] std::size_t left() const {
+		return _size - _position;
+	}
+
+	[[nodiscard]] std::uint8_t byte() {
+		if (_position >= _size) {
+			_failed = true;
+			return 0;
+		}
+		return _data[_position++];
+	}
+	[[nodiscard]] std::uint32_t uint32() {
+		auto result = std::uint32_t();
+		for (auto i = 0; i != 4; ++i) {
+			result |= std::uint32_t(byte()) << (8 * i);
+		}
+		return result;
+	}
+	[[nodiscard]] std::uint64_t varint() {
+		auto result = std::uint64_t();
+		for (auto shift = 0; shift < 64; shift += 7) {
+			const auto value = byte();
+			result |= std::uint64_t(value & 0x7F) << shift;
+			if (!(value & 0x80)) {
+				return result;
+			}
+		}
+		_failed = true;
+		return 0;
+	}
+	[[nodiscard]] std::uint64_t delta(std::uint64_t previous) {
+		const auto value = varint();
+		const auto difference = std::int64_t(value >> 1)
+			^ -std::int64_t(value & 1);
+		return previous + std::uint64_t(difference);
+	}
+	[[nodiscard]] Reader sub(std::size_t size) {
+		if (_size - _position < size) {
+			_failed = true;
+			return Reader(_data, 0);
+		}
+		const auto result = Reader(_data + _position, size);
+		_position += size;
+		return result;
+	}
+	[[nodiscard]] std::string string() {
+		const auto from = reinterpret_cast<const char*>(_data + _position);
+		const auto result = std::string(from, _size - _position);
+		_position = _size;
+		return result;
+	}
+
+private:
+	const std::uint8_t *_data = nullptr;
+	std::size_t _size = 0;
+	std::size_t _position = 0;
+	bool _failed = false;
+
+};
+
+[[nodiscard]] std::vector<Module> ParseMaps(const std::string &maps) {
+	auto result = std::vector<Module>();
+	auto stream = std::istringstream(maps);
+	auto line = std::string();
+	while (std::getline(stream, line)) {
+		auto parsed = std::istringstream(line);
+		auto range = std::string(), permissions = std::string();
+		auto offset = std::string(), device = std::string();
+		auto inode = std::string(), path = std::string();
+		parsed >> range >> permissions >> offset >> device >> inode >> path;
+		const auto dash = range.find('-');
+		if (path.empty()
+			|| path[0] != '/'
+			|| dash == std::string::npos
+			|| permissions.find('x') == std::string::npos) {
+			continue;
+		}
+		result.push_back({
+			.from = std::stoull(range.substr(0, dash), nullptr, 16),
+			.till = std::stoull(range.substr(dash + 1), nullptr, 16),
+			.offset = std::stoull(offset, nullptr, 16),
+			.path = path,
+		});
+	}
+	return result;
+}
+
+[[nodiscard]] bool ParseEvents(
+		Reader &reader,
+		std::uint32_t thread,
+		Trace &trace) {
+	auto time = std::uint64_t();
+	auto pointer = std::uint64_t();
+	while (!reader.atEnd() && !reader.failed()) {
+		const auto tag = EventTag(reader.byte());
+		if (tag == EventTag::Stack) {
+			const auto depth = reader.varint();
+			auto frames = std::vector<std::uint64_t>();
+			auto previous = std::uint64_t();
+			for (auto i = std::uint64_t(); i != depth && !reader.failed(); ++i) {
+				previous = reader.delta(previous);
+				frames.push_back(previous);
+			}
+			if (reader.failed()) {
+				break;
+			} else if (trace.events.empty()) {
+				return false;
+			}
+			// Same callstacks share an index to be grouped later.
+			auto &index = trace.stackIndices[frames];
+			if (!index) {
+				trace.stacks.push_back(std::move(frames));
+				index = std::uint32_t(trace.stacks.size());
+			}
+			trace.events.back().stack = index;
+			continue;
+		}
+		auto event = Event{ .thread = thread, .tag = tag };
+		time += reader.varint();
+		event.time = time;
+		pointer = event.pointer = reader.delta(pointer);
+		switch (tag) {
+		case EventTag::Malloc:
+			event.size = reader.varint();
+			break;
+		case EventTag::Realloc:
+			event.size = reader.varint();
+			pointer = event.result = reader.delta(pointer);
+			break;
+		case EventTag::Free:
+			break;
+		case EventTag::Sampled:
+			event.size = reader.varint();
+			event.rate = reader.varint();
+			++trace.sampled;
+			break;
+		default:
+			return false;
+		}
+		if (reader.failed()) {
+			break;
+		}
+		trace.events.push_back(event);
+	}
+	return !reader.failed();
+}
+
+[[nodiscard]] std::optional<Trace> ReadTrace(const std::vector<std::uint8_t> &data) {
+	auto reader = Reader(data.data(), data.size());
+	const auto magic = reader.uint32();
+	if (memcmp(&magic, "TDAT", 4) || reader.uint32() != kVersion) {
+		return std::nullopt;
+	}
+	auto result = Trace();
+	while (!reader.atEnd() && !reader.failed()) {
+		const auto kind = BlockKind(reader.byte());
+		const auto thread = reader.uint32();
+		const auto size = reader.uint32();
+		if (reader.failed()) {
+			result.truncated = true;
+			break;
+		}
+
+		// Keep the events of a block cut short, the last one may be partial.
+		const auto available = std::min(std::size_t(size), reader.left());
+		const auto complete = (available == size);
+		auto block = reader.sub(available);
+		if (kind == BlockKind::Maps) {
+			if (complete) {
+				result.modules = ParseMaps(block.string());
+			}
+		} else if (kind == BlockKind::Events) {
+			if (!ParseEvents(block, thread, result) && complete) {
+				return std::nullopt;
+			}
+		}
+		if (!complete) {
+			result.truncated = true;
+			break;
+		}
+	}
+	std::stable_sort(
+		begin(result.events),
+		end(result.events),
+		[](const Event &a, const Event &b) { return a.time < b.time; });
+	return result;
+}
+
+[[nodiscard]] std::string FormatBytes(std::uint64_t value) {
+	char buffer[64];
+	if (value >= 1024 * 1024) {
+		snprintf(buffer, sizeof(buffer), "%.2f MB", value / (1024. * 1024.));
+	} else if (value >= 1024) {
+		snprintf(buffer, sizeof(buffer), "%.2f KB", value / 1024.);
+	} else {
+		snprintf(buffer, sizeof(buffer), "%llu B", (unsigned long long)value);
+	}
+	return buffer;
+}
+
+class Symbolizer final {
+public:
+	Symbolizer(const std::vector<Module> &modules, bool addr2line)
+	: _modules(modules)
+	, _addr2line(addr2line) {
+	}
+
+	[[nodiscard]] std::string name(std::uint64_t address) {
+		const auto i = std::find_if(
+			begin(_modules),
+			end(_modules),
+			[&](const Module &module) {
+				return (address >= module.from) && (address < module.till);
+			});
+		if (i == end(_modules)) {
+			return Hex(address);
+		}
+		const auto offset = address - i->from + i->offset;
+		auto result = i->path.substr(i->path.rfind('/') + 1)
+			+ '+'
+			+ Hex(offset);
+		if (_addr2line) {
+			const auto symbol = resolve(i->path, offset);
+			if (!symbol.empty()) {
+				result += ' ' + symbol;
+			}
+		}
+		return result;
+	}
+
+private:
+	[[nodiscard]] static std::string Hex(std::uint64_t value) {
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "0x%llx", (unsigned long long)value);
+		return buffer;
+	}
+
+	// Without a shell, so that paths are passed as they are.
+	[[nodiscard]] static std::string Addr2Line(
+			const std::string &path,
+			const std::string &address) {
+		int fds[2] = { -1, -1 };
+		if (pipe(fds) != 0) {
+			return std::string();
+		}
+		const auto child = fork();
+		if (child == 0) {
+			dup2(fds[1], STDOUT_FILENO);
+			close(fds[0]);
+			close(fds[1]);
+			const char *arguments[] = {
+				"addr2line",
+				"-f",
+				"-C",
+				"-e",
+				path.c_str(),
+				address.c_str(),
+				nullptr,
+			};
+			execvp(arguments[0], const_cast<char**>(arguments));
+			_exit(127);
+		}
+		close(fds[1]);
+		auto result = std::string();
+		if (child > 0) {
+			if (const auto output = fdopen(fds[0], "r")) {
+				char line[1024];
+				if (fgets(line, sizeof(line), output)) {
+					result = line;
+					result.erase(result.find_last_not_of("\r\n") + 1);
+				}
+				fclose(output);
+				fds[0] = -1;
+			}
+			waitpid(child, nullptr, 0);
+		}
+		if (fds[0] >= 0) {
+			close(fds[0]);
+		}
+		return result;
+	}
+
+	[[nodiscard]] std::string resolve(
+			const std::string &path,
+			std::uint64_t offset) {
+		const auto key = path + '@' + Hex(offset);
+		if (const auto i = _cache.find(key); i != end(_cache)) {
+			return i->second;
+		}
+		auto result = Addr2Line(path, Hex(offset));
+		if (result == "??") {
+			result.clear();
+		}
+		return _cache.emplace(key, result).first->second;
+	}
+
+	const std::vector<Module> &_modules;
+	const bool _addr2line = false;
+	std::unordered_map<std::string, std::string> _cache;
+
+};
+
+void Analyze(const Trace &trace, bool addr2line) {
+	struct Live {
+		std::uint64_t size = 0;
+		std::uint64_t count = 0;
+		std::uint64_t bytes = 0;
+		std::uint32_t stack = 0;
+	};
+	struct SizeStats {
+		std::uint64_t count = 0;
+		std::uint64_t bytes = 0;
+	};
+	auto live = std::unordered_map<std::uint64_t, Live>();
+	auto sizes = std::unordered_map<std::uint64_t, SizeStats>();
+	auto liveBytes = std::uint64_t();
+	auto peakBytes = std::uint64_t();
+	auto unknownFrees = std::uint64_t();
+
+	const auto first = trace.events.empty() ? 0 : trace.events.front().time;
+	const auto last = trace.events.empty() ? 0 : trace.events.back().time;
+	const auto bucket = std::max(
+		(last - first + kTimelineBuckets - 1) / kTimelineBuckets,
+		std::uint64_t(1));
+	auto timeline = std::vector<std::uint64_t>(kTimelineBuckets + 1);
+	auto currentBucket = std::uint64_t();
+
+	const auto allocate = [&](const Event &event, std::uint64_t pointer) {
+		// A sampled allocation stands for 1 / probability allocations.
+		const auto weight = event.rate
+			? (1. / -std::expm1(-double(event.size) / double(event.rate)))
+			: 1.;
+		const auto count = std::uint64_t(std::llround(weight));
+		const auto bytes = std::uint64_t(std::llround(weight * event.size));
+		live[pointer] = { event.size, count, bytes, event.stack };
+		liveBytes += bytes;
+		auto &stats = sizes[event.size];
+		stats.count += count;
+		stats.bytes += bytes;
+	};
+	const auto release = [&](std::uint64_t pointer) {
+		const auto i = live.find(pointer);
+		if (i == end(live)) {
+			++unknownFrees;
+			return;
+		}
+		liveBytes -= i->second.bytes;
+		live.erase(i);
+	};
+	for (const auto &event : trace.events) {
+		// Intervals without events keep the live heap of the previous one.
+		const auto index = (event.time - first) / bucket;
+		for (; currentBucket < index; timeline[++currentBucket] = liveBytes) {
+		}
+		switch (event.tag) {
+		case EventTag::Malloc:
+		case EventTag::Sampled:
+			if (event.pointer) {
+				allocate(event, event.pointer);
+			}
+			break;
+		case EventTag::Realloc:
+			if (event.result) {
+				release(event.pointer);
+				allocate(event, event.result);
+			}
+			break;
+		case EventTag::Free:
+			release(event.pointer);
+			break;
+		default:
+			break;
+		}
+		peakBytes = std::max(peakBytes, liveBytes);
+		timeline[index] = std::max(timeline[index], liveBytes);
+	}
+
+	auto liveCount = std::uint64_t();
+	for (const auto &[pointer, allocation] : live) {
+		liveCount += allocation.count;
+	}
+	if (trace.truncated) {
+		std::cout << "The trace is truncated, the last block was cut.\n";
+	}
+	if (trace.sampled) {
+		std::cout
+			<< "Sampled allocations: " << trace.sampled
+			<< ", sizes and counts below are estimated.\n";
+	}
+	std::cout
+		<< "Events: " << trace.events.size()
+		<< ", duration: " << ((last - first) / 1000000.) << " s"
+		<< ", peak live heap: " << FormatBytes(peakBytes)
+		<< ", live at the end: " << FormatBytes(liveBytes)
+		<< " in " << liveCount << " allocations"
+		<< ", unknown frees: " << unknownFrees
+		<< "\n\nLive heap over time (max in each interval):\n";
+	for (auto i = 0; i != kTimelineBuckets + 1; ++i) {
+		const auto width = peakBytes
+			? int(timeline[i] * 60 / peakBytes)
+			: 0;
+		char at[32];
+		snprintf(at, sizeof(at), "%9.3f s ", (i * bucket) / 1000000.);
+		std::cout
+			<< at
+			<< std::string(width, '#')
+			<< ' '
+			<< FormatBytes(timeline[i])
+			<< '\n';
+	}
+
+	auto top = std::vector<std::pair<std::uint64_t, SizeStats>>(
+		begin(sizes),
+		end(sizes));
+	std::sort(begin(top), end(top), [](const auto &a, const auto &b) {
+		return a.second.bytes > b.second.bytes;
+	});
+	std::cout << "\nTop allocation sizes by total bytes:\n";
+	for (auto i = 0; i != std::min(int(top.size()), kTopCount); ++i) {
+		std::cout
+			<< "  " << top[i].first << " bytes x " << top[i].second.count
+			<< " = " << FormatBytes(top[i].second.bytes) << '\n';
+	}
+
+	// Group the allocations still alive at the end by their callstack,
+	// or by their size for those without a sampled callstack.
+	struct Leak {
+		std::uint64_t count = 0;
+		std::uint64_t bytes = 0;
+		std::uint32_t stack = 0;
+		std::uint64_t size = 0;
+	};
+	auto leaks = std::map<std::pair<std::uint32_t, std::uint64_t>, Leak>();
+	for (const auto &[pointer, allocation] : live) {
+		const auto key = std::make_pair(
+			allocation.stack,
+			allocation.stack ? 0 : allocation.size);
+		auto &leak = leaks[key];
+		leak.count += allocation.count;
+		leak.bytes += allocation.bytes;
+		leak.stack = allocation.stack;
+		leak.size = allocation.size;
+	}
+	auto sorted = std::vector<Leak>();
+	for (const auto &[key, leak] : leaks) {
+		sorted.push_back(leak);
+	}
+	std::sort(begin(sorted), end(sorted), [](const Leak &a, const Leak &b) {
+		return a.bytes > b.bytes;
+	});
+	auto symbolizer = Symbolizer(trace.modules, addr2line);
+	std::cout << "\nLeak candidates (alive at the end of the trace):\n";
+	for (auto i = 0; i != std::min(int(sorted.size()), kTopCount); ++i) {
+		const auto &leak = sorted[i];
+		std::cout
+			<< "  " << FormatBytes(leak.bytes) << " in " << leak.count
+			<< " allocations";
+		if (!leak.stack) {
+			std::cout << " of " << leak.size << " bytes, no callstack\n";
+			continue;
+		}
+		std::cout << ", sampled callstack:\n";
+		for (const auto frame : trace.stacks[leak.stack - 1]) {
+			std::cout << "    " << symbolizer.name(frame) << '\n';
+		}
+	}
+}
+
+} // namespace
+
+#ifndef DESKTOP_APP_ALLOCATION_TRACE_ANALYZER_NO_MAIN
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr
+			<< "Usage: " << argv[0] << " <trace> [--symbolize]"
+			<< std::endl;
+		return 1;
+	}
+	auto file = std::ifstream(argv[1], std::ios::binary);
+	if (!file) {
+		std::cerr << "Could not open '" << argv[1] << "'." << std::endl;
+		return 1;
+	}
+	const auto data = std::vector<std::uint8_t>(
+		std::istreambuf_iterator<char>(file),
+		std::istreambuf_iterator<char>());
+	const auto trace = ReadTrace(data);
+	if (!trace) {
+		std::cerr << "Could not parse '" << argv[1] << "'." << std::endl;
+		return 1;
+	}
+	const auto symbolize = (argc > 2)
+		&& (std::string(argv[2]) == "--symbolize");
+	Analyze(*trace, symbolize);
+	return 0;
+}
+
+#endif // !DESKTOP_APP_ALLOCATION_TRACE_ANALYZER_NO_MAIN
@@ -0,0 +1,101 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#define DESKTOP_APP_ALLOCATION_TRACE_ANALYZER_NO_MAIN
+#include "base/platform/linux/base_linux_allocation_trace_analyzer.cpp"
+
+namespace {
+
+class TraceBuilder final {
+public:
+	TraceBuilder() {
+		_data = { 'T', 'D', 'A', 'T' };
+		uint32(_data, kVersion);
+	}
+
+	void malloc(std::uint64_t time, std::uint64_t pointer, int size) {
+		_events.push_back(std::uint8_t(EventTag::Malloc));
+		varint(_events, time - _time);
+		delta(pointer);
+		varint(_events, size);
+		_time = time;
+	}
+	void free(std::uint64_t time, std::uint64_t pointer) {
+		_events.push_back(std::uint8_t(EventTag::Free));
+		varint(_events, time - _time);
+		delta(pointer);
+		_time = time;
+	}
+
+	[[nodiscard]] std::vector<std::uint8_t> finish() {
+		_data.push_back(std::uint8_t(BlockKind::Events));
+		uint32(_data, 1);
+		uint32(_data, std::uint32_t(_events.size()));
+		_data.insert(end(_data), begin(_events), end(_events));
+		_events.clear();
+		return _data;
+	}
+
+private:
+	static void uint32(std::vector<std::uint8_t> &to, std::uint32_t value) {
+		for (auto i = 0; i != 4; ++i) {
+			to.push_back(std::uint8_t(value >> (8 * i)));
+		}
+	}
+	static void varint(std::vector<std::uint8_t> &to, std::uint64_t value) {
+		for (; value >= 0x80; value >>= 7) {
+			to.push_back(std::uint8_t(value | 0x80));
+		}
+		to.push_back(std::uint8_t(value));
+	}
+	void delta(std::uint64_t pointer) {
+		const auto difference = std::int64_t(pointer - _pointer);
+		varint(_events, (std::uint64_t(difference) << 1)
+			^ std::uint64_t(difference >> 63));
+		_pointer = pointer;
+	}
+
+	std::vector<std::uint8_t> _data;
+	std::vector<std::uint8_t> _events;
+	std::uint64_t _time = 0;
+	std::uint64_t _pointer = 0;
+
+};
+
+} // namespace
+
+TEST_CASE("allocation trace analyzer", "[allocation_tracer]") {
+	SECTION("short traces fit the timeline") {
+		for (const auto duration : { 0, 1, 39, 41, 79, 1599, 1601 }) {
+			auto builder = TraceBuilder();
+			builder.malloc(1000, 0x1000, 16);
+			builder.free(1000 + duration, 0x1000);
+			const auto trace = ReadTrace(builder.finish());
+			REQUIRE(trace.has_value());
+			REQUIRE(trace->events.size() == 2);
+			REQUIRE(!trace->truncated);
+			Analyze(*trace, false);
+		}
+	}
+
+	SECTION("a cut block keeps the decoded events") {
+		auto builder = TraceBuilder();
+		for (auto i = 0; i != 100; ++i) {
+			builder.malloc(i * 10, 0x1000 + i * 0x100, 1000 + i);
+		}
+		const auto data = builder.finish();
+		for (const auto cut : { 1, 2, 3, 50, 200 }) {
+			const auto trace = ReadTrace({ begin(data), end(data) - cut });
+			REQUIRE(trace.has_value());
+			REQUIRE(trace->truncated);
+			REQUIRE(!trace->events.empty());
+			REQUIRE(trace->events.size() < 100);
+			REQUIRE(trace->events.back().size < 1100);
+		}
+	}
+}
@@ -8,8 +8,18 @@
 
 #include "base/debug_log.h"
 
-#include <mutex>
-#include <stdio.h>
+#include <QtCore/QFile>
+
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <new>
+#include <optional>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 void SetMallocLogger(void (*logger)(size_t, void *));
@@ -27,43 +37,543 @@ namespace {
 
 #ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
 
-constexpr auto kBufferSize = 1024 * 1024;
+// The loggers are called from inside malloc(), so nothing here may
+// allocate on the heap: thread buffers are mmap()-ed and reused.
+//
+// File: "TDAT" [uint32 version] blocks.
+// Block: [uint8 kind][uint32 thread][uint32 size][payload].
+// Maps block payload: /proc/self/maps contents.
+// Events block payload: events, deltas restart from zero in each block.
+// - Malloc: [1][varint dt][zigzag dptr][varint size]
+// - Realloc: [2][varint dt][zigzag dptr][varint size][zigzag dresult]
+// - Free: [3][varint dt][zigzag dptr]
+// - Stack: [4][varint depth][zigzag dframe]... of the previous event
+// - Sampled: [5][varint dt][zigzag dptr][varint size][varint rate]
+// Time is in microseconds of CLOCK_MONOTONIC.
+//
+// In sampling mode the gaps between sampled bytes are exponentially
+// distributed with the mean of the rate, so an allocation of size S
+// is sampled with probability 1 - exp(-S / rate).
+
+constexpr auto kVersion = std::uint32_t(2);
+constexpr auto kBlockHeader = 1 + 4 + 4;
+constexpr auto kBufferSize = std::size_t(256 * 1024);
+constexpr auto kMaxStackDepth = 32;
+constexpr auto kMaxEventSize = 1 + 10 * 4 + 1 + 10 + kMaxStackDepth * 10;
+constexpr auto kMaxBuffers = 4096;
+constexpr auto kSampledSlots = std::size_t(1) << 18;
+constexpr auto kSampledProbes = 64;
+constexpr auto kRemovedSlot = std::uint64_t(1);
+constexpr auto kSizeClasses = 24; // Up to 16 bytes, up to 32, ..., the rest.
+constexpr auto kStatsStripes = 16;
+constexpr auto kLiveCountScale = 1024.; // Estimated counts are fractional.
+
+enum class BlockKind : std::uint8_t {
+	Maps = 1,
+	Events = 2,
+};
+
+enum class EventTag : std::uint8_t {
+	Malloc = 1,
+	Realloc = 2,
+	Free = 3,
+	Stack = 4,
+	Sampled = 5,
+};
+
+struct SampledEntry {
+	std::atomic<std::uint64_t> pointer;
+	std::atomic<std::uint64_t> size;
+};
+
+// Lock-free open addressing with a bounded probe, samples that don't
+// fit are dropped. Pointers are unique while alive, so there are no
+// concurrent inserts or removes of the same value.
+class SampledTable final {
+public:
+	[[nodiscard]] bool create();
+	void clear();
+
+	[[nodiscard]] bool insert(void *value, std::uint64_t size);
+	[[nodiscard]] std::optional<std::uint64_t> remove(void *value);
+
+private:
+	[[nodiscard]] static std::size_t Slot(std::uint64_t pointer);
+
+	SampledEntry *_entries = nullptr;
+	std::atomic<std::uint32_t> _count = 0;
+
+};
+
+struct SampleCountdown {
+	std::int64_t until = 0;
+	std::uint64_t rate = 0;
+};
+
+// Counters of each thread go to one of the stripes, so that
+// the threads don't fight for the same cache lines.
+struct alignas(64) StatsStripe {
+	std::atomic<std::uint64_t> allocations[kSizeClasses];
+	std::atomic<std::uint64_t> allocatedBytes[kSizeClasses];
+};
+
+struct ThreadBuffer {
+	std::atomic<bool> locked;
+	std::atomic<bool> owned;
+	std::uint32_t thread = 0;
+	std::uint32_t size = 0;
+	std::uint64_t lastTime = 0;
+	std::uint64_t lastPointer = 0;
+	std::uint32_t sinceStack = 0;
+	std::uint8_t data[kBufferSize];
+};
+
+// Used only under a buffer lock, see FinishAllocationTracer().
+std::atomic<int> File = -1;
+std::atomic<bool> Active/* = false*/;
+std::atomic<std::uint32_t> StackSampling/* = 0*/;
+std::atomic<std::uint64_t> SamplingRate/* = 0*/;
+SampledTable TraceSampled;
+std::atomic<std::uint32_t> ThreadIds/* = 0*/;
+std::atomic<ThreadBuffer*> Buffers[kMaxBuffers];
+pthread_key_t ThreadKey;
+bool ThreadKeyCreated/* = false*/;
+
+std::atomic<std::uint64_t> StatsRate/* = 0*/;
+std::uint64_t StatsWeightRate/* = 0*/;
+SampledTable StatsSampled;
+StatsStripe StatsStripes[kStatsStripes];
+std::atomic<std::uint32_t> StatsStripeIds/* = 0*/;
+std::atomic<std::int64_t> LiveCount[kSizeClasses];
+std::atomic<std::int64_t> LiveBytes[kSizeClasses];
+std::atomic<std::int64_t> LiveTotal/* = 0*/;
+std::atomic<std::int64_t> LivePeak/* = 0*/;
+
+thread_local ThreadBuffer *CurrentBuffer/* = nullptr*/;
+thread_local bool InsideLogger/* = false*/;
+thread_local SampleCountdown TraceCountdown;
+thread_local SampleCountdown StatsCountdown;
+thread_local std::uint64_t RandomState/* = 0*/;
+thread_local int CurrentStripe/* = 0*/;
 
-char *Buffer/* = nullptr*/;
-FILE *File/* = 0*/;
-char *Data/* = nullptr*/;
-std::mutex Mutex;
+[[nodiscard]] std::uint64_t Now() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000 * std::uint64_t(ts.tv_sec) + std::uint64_t(ts.tv_nsec) / 1000;
+}
+
+void WriteAll(int file, const void *data, std::size_t size) {
+	auto from = static_cast<const char*>(data);
+	while (size > 0) {
+		const auto written = ::write(file, from, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		from += written;
+		size -= written;
+	}
+}
+
+void PutUInt32(std::uint8_t *to, std::uint32_t value) {
+	memcpy(to, &value, sizeof(value));
+}
+
+void WriteBlock(
+		int file,
+		BlockKind kind,
+		std::uint32_t thread,
+		const void *data,
+		std::size_t size) {
+	std::uint8_t header[kBlockHeader];
+	header[0] = std::uint8_t(kind);
+	PutUInt32(header + 1, thread);
+	PutUInt32(header + 5, std::uint32_t(size));
+	WriteAll(file, header, sizeof(header));
+	WriteAll(file, data, size);
+}
+
+// Each block goes to the file in a single write() with O_APPEND.
+// Must be called with the buffer locked, the events are dropped
+// if the tracer is already finished.
+void FlushBuffer(not_null<ThreadBuffer*> buffer) {
+	const auto file = File.load();
+	if (file >= 0 && buffer->size > kBlockHeader) {
+		buffer->data[0] = std::uint8_t(BlockKind::Events);
+		PutUInt32(buffer->data + 1, buffer->thread);
+		PutUInt32(buffer->data + 5, buffer->size - kBlockHeader);
+		WriteAll(file, buffer->data, buffer->size);
+	}
+	buffer->size = kBlockHeader;
+	buffer->lastTime = buffer->lastPointer = 0;
+}
 
-void WriteBlock() {
-	if (Data > Buffer) {
-		fwrite(Buffer, Data - Buffer, 1, File);
-		fflush(File);
-		fdatasync(fileno(File));
-		Data = Buffer;
+void Lock(not_null<ThreadBuffer*> buffer) {
+	while (buffer->locked.exchange(true, std::memory_order_acquire)) {
 	}
 }
 
-template <size_t Size>
-void AppendEntry(char (&bytes)[Size]) {
-	std::unique_lock<std::mutex> lock(Mutex);
-	if (!File) {
+void Unlock(not_null<ThreadBuffer*> buffer) {
+	buffer->locked.store(false, std::memory_order_release);
+}
+
+[[nodiscard]] ThreadBuffer *ClaimBuffer() {
+	for (auto &slot : Buffers) {
+		const auto buffer = slot.load(std::memory_order_acquire);
+		if (!buffer) {
+			const auto memory = mmap(
+				nullptr,
+				sizeof(ThreadBuffer),
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS,
+				-1,
+				0);
+			if (memory == MAP_FAILED) {
+				return nullptr;
+			}
+			const auto created = new (memory) ThreadBuffer();
+			created->owned = true;
+			auto expected = (ThreadBuffer*)nullptr;
+			if (slot.compare_exchange_strong(expected, created)) {
+				return created;
+			}
+			created->~ThreadBuffer();
+			munmap(memory, sizeof(ThreadBuffer));
+		} else if (!buffer->owned.exchange(true, std::memory_order_acq_rel)) {
+			return buffer;
+		}
+	}
+	return nullptr;
+}
+
+void ReleaseBuffer(void *value) {
+	const auto buffer = static_cast<ThreadBuffer*>(value);
+	Lock(buffer);
+	FlushBuffer(buffer);
+	Unlock(buffer);
+	buffer->owned.store(false, std::memory_order_release);
+	CurrentBuffer = nullptr;
+}
+
+[[nodiscard]] ThreadBuffer *AcquireBuffer() {
+	if (!CurrentBuffer) {
+		CurrentBuffer = ClaimBuffer();
+		if (!CurrentBuffer) {
+			return nullptr;
+		}
+		CurrentBuffer->thread = ++ThreadIds;
+		CurrentBuffer->size = kBlockHeader;
+		CurrentBuffer->lastTime = CurrentBuffer->lastPointer = 0;
+		pthread_setspecific(ThreadKey, CurrentBuffer);
+	}
+	Lock(CurrentBuffer);
+	return CurrentBuffer;
+}
+
+class Writer final {
+public:
+	explicit Writer(not_null<ThreadBuffer*> buffer)
+	: _buffer(buffer)
+	, _to(buffer->data + buffer->size) {
+	}
+
+	void tag(EventTag value) {
+		*_to++ = std::uint8_t(value);
+	}
+	void varint(std::uint64_t value) {
+		while (value >= 0x80) {
+			*_to++ = std::uint8_t(value) | 0x80;
+			value >>= 7;
+		}
+		*_to++ = std::uint8_t(value);
+	}
+	void delta(std::uint64_t value, std::uint64_t previous) {
+		const auto difference = std::int64_t(value - previous);
+		varint((std::uint64_t(difference) << 1)
+			^ std::uint64_t(difference >> 63));
+	}
+	void time() {
+		const auto now = Now();
+		varint(now - std::min(now, _buffer->lastTime));
+		_buffer->lastTime = now;
+	}
+	void pointer(const void *value) {
+		const auto pointer = reinterpret_cast<std::uint64_t>(value);
+		delta(pointer, _buffer->lastPointer);
+		_buffer->lastPointer = pointer;
+	}
+	void stack(bool force = false) {
+		if (!force) {
+			const auto sampling = StackSampling.load(std::memory_order_relaxed);
+			if (!sampling || ++_buffer->sinceStack < sampling) {
+				return;
+			}
+			_buffer->sinceStack = 0;
+		}
+
+		void *frames[kMaxStackDepth + 2];
+		const auto depth = backtrace(frames, kMaxStackDepth + 2);
+		const auto skip = std::min(depth, 2); // The tracer itself.
+		tag(EventTag::Stack);
+		varint(depth - skip);
+		auto previous = std::uint64_t();
+		for (auto i = skip; i != depth; ++i) {
+			const auto frame = reinterpret_cast<std::uint64_t>(frames[i]);
+			delta(frame, previous);
+			previous = frame;
+		}
+	}
+
+	~Writer() {
+		_buffer->size = _to - _buffer->data;
+		if (_buffer->size + kMaxEventSize > kBufferSize) {
+			FlushBuffer(_buffer);
+		}
+	}
+
+private:
+	const not_null<ThreadBuffer*> _buffer;
+	std::uint8_t *_to = nullptr;
+
+};
+
+template <typename Method>
+void Log(Method &&method) {
+	if (InsideLogger || !Active.load(std::memory_order_acquire)) {
 		return;
-	} else if (Data + Size > Buffer + kBufferSize) {
-		WriteBlock();
 	}
-	*reinterpret_cast<std::uint32_t*>(bytes + 1) = uint32_t(time(nullptr));
-	memcpy(Data, bytes, Size);
-	Data += Size;
+	InsideLogger = true;
+	if (const auto buffer = AcquireBuffer()) {
+		{
+			auto writer = Writer(buffer);
+			method(writer);
+		}
+		Unlock(buffer);
+	}
+	InsideLogger = false;
+}
+
+bool SampledTable::create() {
+	if (_entries) {
+		return true;
+	}
+	const auto memory = mmap(
+		nullptr,
+		kSampledSlots * sizeof(SampledEntry),
+		PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+		-1,
+		0);
+	if (memory == MAP_FAILED) {
+		return false;
+	}
+	_entries = static_cast<SampledEntry*>(memory);
+	return true;
+}
+
+void SampledTable::clear() {
+	if (_entries) {
+		for (auto i = std::size_t(); i != kSampledSlots; ++i) {
+			_entries[i].pointer.store(0, std::memory_order_relaxed);
+		}
+	}
+	_count.store(0, std::memory_order_release);
+}
+
+std::size_t SampledTable::Slot(std::uint64_t pointer) {
+	return std::size_t((pointer >> 4) * 0x9E3779B97F4A7C15ULL)
+		& (kSampledSlots - 1);
+}
+
+bool SampledTable::insert(void *value, std::uint64_t size) {
+	const auto pointer = reinterpret_cast<std::uint64_t>(value);
+	const auto start = Slot(pointer);
+	for (auto i = 0; i != kSampledProbes; ++i) {
+		auto &entry = _entries[(start + i) & (kSampledSlots - 1)];
+		auto was = entry.pointer.load(std::memory_order_relaxed);
+		while (was == 0 || was == kRemovedSlot) {
+			if (entry.pointer.compare_exchange_weak(
+					was,
+					pointer,
+					std::memory_order_acq_rel)) {
+				entry.size.store(size, std::memory_order_relaxed);
+				_count.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+std::optional<std::uint64_t> SampledTable::remove(void *value) {
+	if (!_count.load(std::memory_order_relaxed)) {
+		return std::nullopt;
+	}
+	const auto pointer = reinterpret_cast<std::uint64_t>(value);
+	const auto start = Slot(pointer);
+	for (auto i = 0; i != kSampledProbes; ++i) {
+		auto &entry = _entries[(start + i) & (kSampledSlots - 1)];
+		const auto was = entry.pointer.load(std::memory_order_acquire);
+		if (was == pointer) {
+			const auto size = entry.size.load(std::memory_order_relaxed);
+			entry.pointer.store(kRemovedSlot, std::memory_order_release);
+			_count.fetch_sub(1, std::memory_order_relaxed);
+			return size;
+		} else if (!was) {
+			break;
+		}
+	}
+	return std::nullopt;
+}
+
+[[nodiscard]] std::int64_t NextSampleGap(std::uint64_t rate) {
+	if (!RandomState) {
+		RandomState = Now() ^ reinterpret_cast<std::uint64_t>(&RandomState);
+		RandomState |= 1;
+	}
+	// xorshift64*, top 53 bits give a uniform value in (0, 1].
+	RandomState ^= RandomState >> 12;
+	RandomState ^= RandomState << 25;
+	RandomState ^= RandomState >> 27;
+	const auto random = RandomState * 0x2545F4914F6CDD1DULL;
+	const auto uniform = ((random >> 11) + 1) * (1. / (1ULL << 53));
+	return std::int64_t(-std::log(uniform) * double(rate)) + 1;
+}
+
+// The fast path of the sampling mode, no locks and no atomic writes.
+[[nodiscard]] bool ShouldSample(
+		SampleCountdown &countdown,
+		size_t size,
+		std::uint64_t rate) {
+	if (countdown.rate != rate) {
+		countdown.rate = rate;
+		countdown.until = NextSampleGap(rate);
+	}
+	countdown.until -= std::int64_t(size);
+	if (countdown.until > 0) {
+		return false;
+	}
+	// Large allocations may cover several sample points at once,
+	// they are still recorded once with their real size.
+	do {
+		countdown.until += NextSampleGap(rate);
+	} while (countdown.until <= 0);
+	return true;
+}
+
+[[nodiscard]] int SizeClass(std::uint64_t size) {
+	const auto bits = int(std::bit_width(std::max(size, std::uint64_t(1)) - 1));
+	return std::clamp(bits - 4, 0, kSizeClasses - 1);
+}
+
+void CountLive(std::uint64_t size, int sign) {
+	// A sampled allocation stands for 1 / probability allocations.
+	const auto rate = double(StatsWeightRate);
+	const auto weight = 1. / -std::expm1(-double(std::max(size, std::uint64_t(1))) / rate);
+	const auto count = std::int64_t(std::llround(weight * kLiveCountScale))
+		* sign;
+	const auto bytes = std::int64_t(std::llround(weight * double(size))) * sign;
+	const auto index = SizeClass(size);
+	LiveCount[index].fetch_add(count, std::memory_order_relaxed);
+	LiveBytes[index].fetch_add(bytes, std::memory_order_relaxed);
+	const auto total = LiveTotal.fetch_add(bytes, std::memory_order_relaxed)
+		+ bytes;
+	auto peak = LivePeak.load(std::memory_order_relaxed);
+	while (total > peak
+		&& !LivePeak.compare_exchange_weak(
+			peak,
+			total,
+			std::memory_order_relaxed)) {
+	}
+}
+
+void CountAllocation(size_t size, void *result) {
+	const auto rate = StatsRate.load(std::memory_order_relaxed);
+	if (!rate || !result) {
+		return;
+	} else if (!CurrentStripe) {
+		CurrentStripe = 1 + int(StatsStripeIds++ % kStatsStripes);
+	}
+	auto &stripe = StatsStripes[CurrentStripe - 1];
+	const auto index = SizeClass(size);
+	stripe.allocations[index].fetch_add(1, std::memory_order_relaxed);
+	stripe.allocatedBytes[index].fetch_add(size, std::memory_order_relaxed);
+	if (ShouldSample(StatsCountdown, size, rate)
+		&& StatsSampled.insert(result, size)) {
+		CountLive(size, 1);
+	}
+}
+
+void CountFree(void *ptr) {
+	if (const auto size = StatsSampled.remove(ptr)) {
+		CountLive(*size, -1);
+	}
+}
+
+void TraceAllocation(size_t size, void *result) {
+	if (!Active.load(std::memory_order_relaxed)) {
+		return;
+	}
+	const auto rate = SamplingRate.load(std::memory_order_relaxed);
+	if (!rate) {
+		Log([&](Writer &writer) {
+			writer.tag(EventTag::Malloc);
+			writer.time();
+			writer.pointer(result);
+			writer.varint(size);
+			writer.stack();
+		});
+	} else if (result && ShouldSample(TraceCountdown, size, rate)) {
+		Log([&](Writer &writer) {
+			if (!TraceSampled.insert(result, size)) {
+				return;
+			}
+			writer.tag(EventTag::Sampled);
+			writer.time();
+			writer.pointer(result);
+			writer.varint(size);
+			writer.varint(rate);
+			writer.stack(true);
+		});
+	}
+}
+
+void TraceFree(void *ptr) {
+	if (TraceSampled.remove(ptr)
+		|| !SamplingRate.load(std::memory_order_relaxed)) {
+		Log([&](Writer &writer) {
+			writer.tag(EventTag::Free);
+			writer.time();
+			writer.pointer(ptr);
+		});
+	}
+}
+
+void TraceReallocation(void *ptr, size_t size, void *result) {
+	if (SamplingRate.load(std::memory_order_relaxed)) {
+		if (result || !size) {
+			TraceFree(ptr);
+		}
+		if (result) {
+			TraceAllocation(size, result);
+		}
+		return;
+	}
+	Log([&](Writer &writer) {
+		writer.tag(EventTag::Realloc);
+		writer.time();
+		writer.pointer(ptr);
+		writer.varint(size);
+		writer.pointer(result);
+		writer.stack();
+	});
 }
 
 void MallocLogger(size_t size, void *result) {
-	char entry[5 + sizeof(std::uint64_t) * 2];
-	entry[0] = 1;
-	*reinterpret_cast<std::uint64_t*>(entry + 5)
-		= static_cast<std::uint64_t>(size);
-	*reinterpret_cast<std::uint64_t*>(entry + 5 + sizeof(std::uint64_t))
-		= reinterpret_cast<std::uint64_t>(result);
-	AppendEntry(entry);
+	CountAllocation(size, result);
+	TraceAllocation(size, result);
 }
 
 void VallocLogger(size_t size, void *result) {
@@ -82,15 +592,11 @@ void ReallocLogger(void *ptr, size_t size, void *result) {
 	if (!ptr) {
 		return MallocLogger(size, result);
 	}
-	char entry[5 + sizeof(std::uint64_t) * 3];
-	entry[0] = 2;
-	*reinterpret_cast<std::uint64_t*>(entry + 5)
-		= reinterpret_cast<std::uint64_t>(ptr);
-	*reinterpret_cast<std::uint64_t*>(entry + 5 + sizeof(std::uint64_t))
-		= static_cast<std::uint64_t>(size);
-	*reinterpret_cast<std::uint64_t*>(entry + 5 + sizeof(std::uint64_t) * 2)
-		= reinterpret_cast<std::uint64_t>(result);
-	AppendEntry(entry);
+	if (result || !size) {
+		CountFree(ptr);
+	}
+	CountAllocation(size, result);
+	TraceReallocation(ptr, size, result);
 }
 
 void MemAlignLogger(size_t alignment, size_t size, void *result) {
@@ -107,36 +613,36 @@ void PosixMemAlignLogger(size_t alignment, size_t size, void *result) {
 
 void FreeLogger(void *ptr) {
 	if (ptr) {
-		char entry[5 + sizeof(std::uint64_t)];
-		entry[0] = 3;
-		*reinterpret_cast<std::uint64_t*>(entry + 5)
-			= reinterpret_cast<std::uint64_t>(ptr);
-		AppendEntry(entry);
-	}
-}
-
-void InstallLoggers() {
-	SetMallocLogger(MallocLogger);
-	SetVallocLogger(VallocLogger);
-	SetPVallocLogger(PVallocLogger);
-	SetCallocLogger(CallocLogger);
-	SetReallocLogger(ReallocLogger);
-	SetMemAlignLogger(MemAlignLogger);
-	SetAlignedAllocLogger(AlignedAllocLogger);
-	SetPosixMemAlignLogger(PosixMemAlignLogger);
-	SetFreeLogger(FreeLogger);
-}
-
-void RemoveLoggers() {
-	SetMallocLogger(nullptr);
-	SetVallocLogger(nullptr);
-	SetPVallocLogger(nullptr);
-	SetCallocLogger(nullptr);
-	SetReallocLogger(nullptr);
-	SetMemAlignLogger(nullptr);
-	SetAlignedAllocLogger(nullptr);
-	SetPosixMemAlignLogger(nullptr);
-	SetFreeLogger(nullptr);
+		CountFree(ptr);
+		TraceFree(ptr);
+	}
+}
+
+void WriteMaps(int file) {
+	auto maps = QFile("/proc/self/maps");
+	if (maps.open(QIODevice::ReadOnly)) {
+		const auto content = maps.readAll();
+		WriteBlock(
+			file,
+			BlockKind::Maps,
+			0,
+			content.constData(),
+			content.size());
+	}
+}
+
+// The loggers stay installed while the tracer or the stats are active.
+void UpdateLoggers() {
+	const auto active = Active.load() || StatsRate.load();
+	SetMallocLogger(active ? MallocLogger : nullptr);
+	SetVallocLogger(active ? VallocLogger : nullptr);
+	SetPVallocLogger(active ? PVallocLogger : nullptr);
+	SetCallocLogger(active ? CallocLogger : nullptr);
+	SetReallocLogger(active ? ReallocLogger : nullptr);
+	SetMemAlignLogger(active ? MemAlignLogger : nullptr);
+	SetAlignedAllocLogger(active ? AlignedAllocLogger : nullptr);
+	SetPosixMemAlignLogger(active ? PosixMemAlignLogger : nullptr);
+	SetFreeLogger(active ? FreeLogger : nullptr);
 }
 
 #endif // DESKTOP_APP_USE_ALLOCATION_TRACER
@@ -145,31 +651,154 @@ void RemoveLoggers() {
 
 void SetAllocationTracerPath(const QString &path) {
 #ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
-	Expects(!Buffer);
+	Expects(File.load() < 0);
 
-	Data = Buffer = new char[kBufferSize];
-	if (!Buffer) {
+	if (!TraceSampled.create()) {
 		return;
 	}
-	File = fopen(path.toStdString().c_str(), "wb");
-	if (!File) {
+	// Threads keep their buffers between the tracing sessions.
+	if (!ThreadKeyCreated) {
+		if (pthread_key_create(&ThreadKey, ReleaseBuffer) != 0) {
+			return;
+		}
+		ThreadKeyCreated = true;
+	}
+	const auto file = open(
+		QFile::encodeName(path).constData(),
+		O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+		0644);
+	if (file < 0) {
 		return;
 	}
-	InstallLoggers();
+	WriteAll(file, "TDAT", 4);
+	WriteAll(file, &kVersion, sizeof(kVersion));
+	WriteMaps(file);
+	File = file;
+
+	// backtrace() allocates when called for the first time.
+	void *frames[kMaxStackDepth];
+	backtrace(frames, kMaxStackDepth);
+
+	// Samples of the previous session would be reported as freed.
+	TraceSampled.clear();
+	Active = true;
+	UpdateLoggers();
+#endif // DESKTOP_APP_USE_ALLOCATION_TRACER
+}
+
+void SetAllocationTracerStackSampling(int everyAllocations) {
+#ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
+	StackSampling = std::uint32_t(std::max(everyAllocations, 0));
+#endif // DESKTOP_APP_USE_ALLOCATION_TRACER
+}
+
+void SetAllocationTracerSampling(int64 bytesPerSample) {
+#ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
+	SamplingRate = std::uint64_t(std::max(bytesPerSample, int64(0)));
 #endif // DESKTOP_APP_USE_ALLOCATION_TRACER
 }
 
 void FinishAllocationTracer() {
 #ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
-	if (File) {
-		RemoveLoggers();
+	const auto file = File.load();
+	if (file >= 0) {
+		Active = false;
+		UpdateLoggers();
 
-		std::unique_lock<std::mutex> lock(Mutex);
-		WriteBlock();
-		fclose(File);
-		File = nullptr;
+		for (auto &slot : Buffers) {
+			if (const auto buffer = slot.load()) {
+				Lock(buffer);
+				FlushBuffer(buffer);
+				Unlock(buffer);
+			}
+		}
+		// Libraries could be loaded after the start.
+		WriteMaps(file);
+
+		// Writes happen only under a buffer lock, so once each lock
+		// was taken after the reset nobody uses the descriptor.
+		File = -1;
+		for (auto &slot : Buffers) {
+			if (const auto buffer = slot.load()) {
+				Lock(buffer);
+				Unlock(buffer);
+			}
+		}
+		fdatasync(file);
+		close(file);
+	}
+#endif // DESKTOP_APP_USE_ALLOCATION_TRACER
+}
+
+void StartAllocationStats(int64 bytesPerSample) {
+#ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
+	Expects(bytesPerSample > 0);
+
+	if (StatsRate.load() || !StatsSampled.create()) {
+		return;
+	}
+	StatsSampled.clear();
+	for (auto &stripe : StatsStripes) {
+		for (auto i = 0; i != kSizeClasses; ++i) {
+			stripe.allocations[i] = 0;
+			stripe.allocatedBytes[i] = 0;
+		}
+	}
+	for (auto i = 0; i != kSizeClasses; ++i) {
+		LiveCount[i] = 0;
+		LiveBytes[i] = 0;
+	}
+	LiveTotal = LivePeak = 0;
+	StatsWeightRate = std::uint64_t(bytesPerSample);
+	StatsRate = std::uint64_t(bytesPerSample);
+	UpdateLoggers();
+#endif // DESKTOP_APP_USE_ALLOCATION_TRACER
+}
+
+void StopAllocationStats() {
+#ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
+	if (StatsRate.exchange(0)) {
+		UpdateLoggers();
+	}
+#endif // DESKTOP_APP_USE_ALLOCATION_TRACER
+}
+
+AllocationStatistics AllocationStats() {
+	auto result = AllocationStatistics();
+	result.when = crl::now();
+#ifdef DESKTOP_APP_USE_ALLOCATION_TRACER
+	if (!StatsWeightRate) {
+		return result;
+	}
+	result.sizeClasses.resize(kSizeClasses);
+	for (auto i = 0; i != kSizeClasses; ++i) {
+		auto &entry = result.sizeClasses[i];
+		entry.maxSize = (i + 1 < kSizeClasses)
+			? (int64(16) << i)
+			: std::numeric_limits<int64>::max();
+		for (const auto &stripe : StatsStripes) {
+			entry.allocations += int64(
+				stripe.allocations[i].load(std::memory_order_relaxed));
+			entry.allocatedBytes += int64(
+				stripe.allocatedBytes[i].load(std::memory_order_relaxed));
+		}
+		entry.liveCount = std::max(
+			int64(LiveCount[i].load(std::memory_order_relaxed)
+				/ kLiveCountScale),
+			int64(0));
+		entry.liveBytes = std::max(
+			LiveBytes[i].load(std::memory_order_relaxed),
+			int64(0));
+		result.allocations += entry.allocations;
+		result.allocatedBytes += entry.allocatedBytes;
+		result.liveCount += entry.liveCount;
+		result.liveBytes += entry.liveBytes;
 	}
+	result.peakLiveBytes = std::max(
+		LivePeak.load(std::memory_order_relaxed),
+		result.liveBytes);
 #endif // DESKTOP_APP_USE_ALLOCATION_TRACER
+	return result;
 }
 
 } // namespace base::Platform
@@ -8,7 +8,42 @@
 
 namespace base::Platform {
 
+struct AllocationSizeClass {
+	int64 maxSize = 0;
+	int64 allocations = 0;
+	int64 allocatedBytes = 0;
+	int64 liveCount = 0;
+	int64 liveBytes = 0;
+};
+
+// Totals are cumulative since the start, rates come from two snapshots.
+// Live values and the peak are estimated from sampled allocations.
+struct AllocationStatistics {
+	crl::time when = 0;
+	int64 allocations = 0;
+	int64 allocatedBytes = 0;
+	int64 liveCount = 0;
+	int64 liveBytes = 0;
+	int64 peakLiveBytes = 0;
+	std::vector<AllocationSizeClass> sizeClasses;
+};
+
 void SetAllocationTracerPath(const QString &path);
+
+// Capture the callstack of each N-th allocation in a thread, 0 to disable.
+void SetAllocationTracerStackSampling(int everyAllocations);
+
+// Record one allocation per N allocated bytes on average, 0 to record all.
+// Sampled allocations always capture the callstack and only their frees
+// are recorded. Allocations made before switching the mode stay untracked.
+void SetAllocationTracerSampling(int64 bytesPerSample);
+
 void FinishAllocationTracer();
 
+// Aggregate allocations in-process, without a trace file. Frees are
+// counted only for one sampled allocation per N allocated bytes.
+void StartAllocationStats(int64 bytesPerSample = 64 * 1024);
+void StopAllocationStats();
+[[nodiscard]] AllocationStatistics AllocationStats();
+
 } // namespace base::Platform
@@ -0,0 +1,203 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/profile_trace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+
+#include <chrono>
+#include <mutex>
+
+namespace base::profile {
+namespace details {
+
+std::atomic<bool> Enabled/* = false*/;
+
+} // namespace details
+namespace {
+
+constexpr auto kMaxEventsPerThread = std::size_t(1024 * 1024);
+
+struct Event {
+	const char *name = nullptr;
+	uint64 begin = 0;
+	uint64 end = 0;
+};
+
+struct ThreadEvents {
+	std::mutex mutex;
+	std::vector<Event> events;
+	QByteArray name;
+	uint32 id = 0;
+	uint32 dropped = 0;
+};
+
+class Trace final {
+public:
+	[[nodiscard]] not_null<ThreadEvents*> current();
+	void clear();
+	[[nodiscard]] QByteArray serialize();
+
+private:
+	std::mutex _mutex;
+	std::vector<std::shared_ptr<ThreadEvents>> _threads;
+	uint32 _lastId = 0;
+
+};
+
+Trace GlobalTrace;
+thread_local std::shared_ptr<ThreadEvents> CurrentEvents;
+
+not_null<ThreadEvents*> Trace::current() {
+	if (!CurrentEvents) {
+		auto events = std::make_shared<ThreadEvents>();
+		const auto thread = QThread::currentThread();
+		const auto app = QCoreApplication::instance();
+		events->name = (app && thread == app->thread())
+			? QByteArray("Main")
+			: thread
+			? thread->objectName().toUtf8()
+			: QByteArray();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		events->id = ++_lastId;
+		_threads.push_back(events);
+		CurrentEvents = std::move(events);
+	}
+	return CurrentEvents.get();
+}
+
+void Trace::clear() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (const auto &thread : _threads) {
+		std::lock_guard<std::mutex> lock(thread->mutex);
+		thread->events = std::vector<Event>();
+		thread->dropped = 0;
+	}
+}
+
+void AppendEscaped(QByteArray &to, const char *text) {
+	for (auto ch = text; *ch; ++ch) {
+		if (*ch == '"' || *ch == '\\') {
+			to.append('\\');
+		} else if (uchar(*ch) < 0x20) {
+			continue;
+		}
+		to.append(*ch);
+	}
+}
+
+QByteArray Trace::serialize() {
+	// Timestamps are in microseconds, keep the nanoseconds as fraction.
+	const auto time = [](uint64 value) {
+		return QByteArray::number(value / 1000)
+			+ '.'
+			+ QByteArray::number(value % 1000).rightJustified(3, '0');
+	};
+	auto result = QByteArray("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	auto first = true;
+	const auto separator = [&] {
+		if (!first) {
+			result.append(',');
+		}
+		first = false;
+	};
+	const auto pid = QByteArray::number(QCoreApplication::applicationPid());
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (const auto &thread : _threads) {
+		std::lock_guard<std::mutex> lock(thread->mutex);
+		const auto tid = QByteArray::number(thread->id);
+		separator();
+		result.append("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":"
+			+ pid
+			+ ",\"tid\":"
+			+ tid
+			+ ",\"args\":{\"name\":\"");
+		AppendEscaped(result, thread->name.isEmpty()
+			? QByteArray("Thread " + tid).constData()
+			: thread->name.constData());
+		result.append("\"}}");
+		for (const auto &event : thread->events) {
+			separator();
+			result.append("{\"ph\":\"X\",\"name\":\"");
+			AppendEscaped(result, event.name);
+			result.append("\",\"pid\":"
+				+ pid
+				+ ",\"tid\":"
+				+ tid
+				+ ",\"ts\":"
+				+ time(event.begin)
+				+ ",\"dur\":"
+				+ time(event.end - event.begin)
+				+ '}');
+		}
+		if (thread->dropped) {
+			separator();
+			result.append("{\"ph\":\"i\",\"s\":\"t\",\"name\":\"dropped "
+				+ QByteArray::number(thread->dropped)
+				+ " spans\",\"pid\":"
+				+ pid
+				+ ",\"tid\":"
+				+ tid
+				+ ",\"ts\":"
+				+ time(thread->events.empty() ? 0 : thread->events.back().end)
+				+ '}');
+		}
+	}
+	result.append("]}");
+	return result;
+}
+
+} // namespace
+
+namespace details {
+
+uint64 Now() {
+	return uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Record(const char *name, uint64 begin, uint64 end) {
+	const auto events = GlobalTrace.current();
+	std::lock_guard<std::mutex> lock(events->mutex);
+	if (events->events.size() < kMaxEventsPerThread) {
+		events->events.push_back({ name, begin, end });
+	} else {
+		++events->dropped;
+	}
+}
+
+} // namespace details
+
+void Start() {
+	details::Enabled.store(true, std::memory_order_relaxed);
+}
+
+void Stop() {
+	details::Enabled.store(false, std::memory_order_relaxed);
+}
+
+void Clear() {
+	GlobalTrace.clear();
+}
+
+QByteArray ExportChromeTrace() {
+	return GlobalTrace.serialize();
+}
+
+bool ExportChromeTrace(const QString &path) {
+	auto file = QFile(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	const auto data = ExportChromeTrace();
+	return (file.write(data) == data.size());
+}
+
+} // namespace base::profile
@@ -0,0 +1,65 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+#include "base/basic_types.h"
+
+#include <atomic>
+
+// Scoped spans with nanosecond timestamps, recorded only between
+// Start() and Stop() and exported in the Chrome trace event format,
+// that is opened by chrome://tracing and ui.perfetto.dev.
+
+namespace base::profile {
+
+void Start();
+void Stop();
+void Clear();
+
+[[nodiscard]] QByteArray ExportChromeTrace();
+bool ExportChromeTrace(const QString &path);
+
+namespace details {
+
+extern std::atomic<bool> Enabled;
+
+[[nodiscard]] uint64 Now();
+void Record(const char *name, uint64 begin, uint64 end);
+
+} // namespace details
+
+class Scope final {
+public:
+	// The name should be a string literal, only the pointer is stored.
+	explicit Scope(const char *name)
+	: _name(details::Enabled.load(std::memory_order_relaxed)
+		? name
+		: nullptr)
+	, _begin(_name ? details::Now() : 0) {
+	}
+	Scope(const Scope &other) = delete;
+	Scope &operator=(const Scope &other) = delete;
+	~Scope() {
+		if (_name) {
+			details::Record(_name, _begin, details::Now());
+		}
+	}
+
+private:
+	const char * const _name = nullptr;
+	const uint64 _begin = 0;
+
+};
+
+} // namespace base::profile
+
+#define PROFILE_SCOPE_NAME_HELPER(line) BaseProfileScope##line
+#define PROFILE_SCOPE_NAME(line) PROFILE_SCOPE_NAME_HELPER(line)
+
+#define PROFILE_SCOPE(name) const auto PROFILE_SCOPE_NAME(__LINE__)\
+	= ::base::profile::Scope(name)
+//usage PROFILE_SCOPE("startup");
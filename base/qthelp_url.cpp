@@ -32,6 +32,324 @@ QString ExpressionIpExplicit() {
 	return QString::fromUtf8("(?<![\\w\\$\\-\\_%=\\.])(?:([a-zA-Z]+)://)(((25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\.){3}(25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)(\\:\\d+)?)");
 }
 
+constexpr auto kMaxDomainLabels = 10;
+constexpr auto kMinTldLength = 2;
+constexpr auto kMaxTldLength = 22;
+
+enum class LinkKind {
+	Domain,
+	DomainExplicit,
+	IpExplicit,
+};
+
+// Non-ASCII \w and \d are rare near links, so they are checked with
+// the same regexps engine to follow its Unicode tables exactly.
+[[nodiscard]] bool MatchesOne(const QRegularExpression &re, char32_t code) {
+	return re.match(QString::fromUcs4(&code, 1)).hasMatch();
+}
+
+[[nodiscard]] bool IsAsciiLetter(char32_t code) {
+	return (code >= 'a' && code <= 'z') || (code >= 'A' && code <= 'Z');
+}
+
+[[nodiscard]] bool IsAsciiDigit(char32_t code) {
+	return (code >= '0' && code <= '9');
+}
+
+[[nodiscard]] bool IsWordChar(char32_t code) {
+	static const auto word = CreateRegExp("^\\w$");
+	return (code < 0x80)
+		? (IsAsciiLetter(code) || IsAsciiDigit(code) || code == '_')
+		: MatchesOne(word, code);
+}
+
+[[nodiscard]] bool IsDigit(char32_t code) {
+	static const auto digit = CreateRegExp("^\\d$");
+	return (code < 0x80) ? IsAsciiDigit(code) : MatchesOne(digit, code);
+}
+
+// [A-Za-zА-ЯЁа-яё0-9\-\_]
+[[nodiscard]] bool IsLabelChar(char32_t code) {
+	return IsAsciiLetter(code)
+		|| IsAsciiDigit(code)
+		|| (code == '-')
+		|| (code == '_')
+		|| (code >= 0x0410 && code <= 0x044F)
+		|| (code == 0x0401)
+		|| (code == 0x0451);
+}
+
+// [A-Za-zрф\-\d]
+[[nodiscard]] bool IsTldChar(char32_t code) {
+	return IsAsciiLetter(code)
+		|| (code == '-')
+		|| (code == 0x0440)
+		|| (code == 0x0444)
+		|| IsDigit(code);
+}
+
+// Zero outside of the text.
+[[nodiscard]] char16_t At(QStringView text, qsizetype position) {
+	return (position < text.size()) ? text[position].unicode() : 0;
+}
+
+struct CodePoint {
+	char32_t code = 0;
+	int size = 0;
+};
+
+[[nodiscard]] CodePoint CodePointAt(QStringView text, qsizetype position) {
+	const auto ch = text[position];
+	if (ch.isHighSurrogate() && position + 1 < text.size()) {
+		const auto next = text[position + 1];
+		if (next.isLowSurrogate()) {
+			return { QChar::surrogateToUcs4(ch, next), 2 };
+		}
+	}
+	return { ch.unicode(), 1 };
+}
+
+// (?<![\w\$\-\_%=\.])
+[[nodiscard]] bool GoodLinkStart(QStringView text, qsizetype position) {
+	if (!position) {
+		return true;
+	}
+	const auto ch = text[position - 1];
+	auto code = char32_t(ch.unicode());
+	if (ch.isLowSurrogate() && position > 1) {
+		const auto previous = text[position - 2];
+		if (previous.isHighSurrogate()) {
+			code = QChar::surrogateToUcs4(previous, ch);
+		}
+	}
+	return (code != '$')
+		&& (code != '-')
+		&& (code != '%')
+		&& (code != '=')
+		&& (code != '.')
+		&& !IsWordChar(code);
+}
+
+// Counts code points while the test passes, up to the limit.
+template <typename Test>
+[[nodiscard]] std::pair<qsizetype, int> SkipCodePoints(
+		QStringView text,
+		qsizetype from,
+		int limit,
+		Test test) {
+	auto count = 0;
+	while (count < limit && from < text.size()) {
+		const auto [code, size] = CodePointAt(text, from);
+		if (!test(code)) {
+			break;
+		}
+		from += size;
+		++count;
+	}
+	return { from, count };
+}
+
+// (\:\d+)?
+[[nodiscard]] qsizetype SkipPort(QStringView text, qsizetype from) {
+	if (At(text, from) == ':') {
+		const auto [till, count] = SkipCodePoints(
+			text,
+			from + 1,
+			std::numeric_limits<int>::max(),
+			IsDigit);
+		if (count > 0) {
+			return till;
+		}
+	}
+	return from;
+}
+
+// ([a-zA-Z]+)://
+[[nodiscard]] qsizetype SkipProtocol(QStringView text, qsizetype from) {
+	auto till = from;
+	while (IsAsciiLetter(At(text, till))) {
+		++till;
+	}
+	return (till > from
+		&& At(text, till) == ':'
+		&& At(text, till + 1) == '/'
+		&& At(text, till + 2) == '/')
+		? (till + 3)
+		: from;
+}
+
+[[nodiscard]] LinkMatch FillMatch(
+		QStringView text,
+		qsizetype start,
+		qsizetype host,
+		qsizetype tld,
+		qsizetype tldEnd) {
+	const auto end = SkipPort(text, tldEnd);
+	return {
+		.start = start,
+		.length = end - start,
+		.protocol = (host > start)
+			? text.mid(start, host - start - 3)
+			: QStringView(),
+		.domain = text.mid(host, end - host),
+		.tld = text.mid(tld, tldEnd - tld),
+		.port = (end > tldEnd)
+			? text.mid(tldEnd, end - tldEnd)
+			: QStringView(),
+	};
+}
+
+// ((?:[A-Za-zА-ЯЁа-яё0-9\-\_]+\.){1,10}([A-Za-zрф\-\d]{2,22})(\:\d+)?)
+// The labels can't backtrack, so only their count is tried in reverse.
+[[nodiscard]] LinkMatch MatchDomain(
+		QStringView text,
+		qsizetype start,
+		qsizetype host,
+		int minLabels) {
+	qsizetype labels[kMaxDomainLabels + 1] = { host };
+	auto count = 0;
+	while (count < kMaxDomainLabels) {
+		auto till = labels[count];
+		while (till < text.size() && IsLabelChar(At(text, till))) {
+			++till;
+		}
+		if (till == labels[count] || At(text, till) != '.') {
+			break;
+		}
+		labels[++count] = till + 1;
+	}
+	for (; count >= minLabels; --count) {
+		const auto tld = labels[count];
+		const auto [tldEnd, length] = SkipCodePoints(
+			text,
+			tld,
+			kMaxTldLength,
+			IsTldChar);
+		if (length >= kMinTldLength) {
+			return FillMatch(text, start, host, tld, tldEnd);
+		}
+	}
+	return {};
+}
+
+// (25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?), lengths in the order of tries.
+[[nodiscard]] std::array<int, 3> OctetLengths(
+		QStringView text,
+		qsizetype from) {
+	auto result = std::array<int, 3>{ { 0, 0, 0 } };
+	const auto c0 = At(text, from);
+	const auto c1 = At(text, from + 1);
+	const auto c2 = At(text, from + 2);
+	if (!IsAsciiDigit(c0)) {
+		return result;
+	}
+	auto index = 0;
+	if ((c0 == '2' && c1 == '5' && c2 >= '0' && c2 <= '5')
+		|| (c0 == '2' && c1 >= '0' && c1 <= '4' && IsAsciiDigit(c2))
+		|| (c0 <= '1' && IsAsciiDigit(c1) && IsAsciiDigit(c2))) {
+		result[index++] = 3;
+	}
+	if (IsAsciiDigit(c1)) {
+		result[index++] = 2;
+	}
+	result[index] = 1;
+	return result;
+}
+
+// Returns the start and the end of the last octet.
+[[nodiscard]] std::optional<std::pair<qsizetype, qsizetype>> MatchOctets(
+		QStringView text,
+		qsizetype from,
+		int index) {
+	for (const auto length : OctetLengths(text, from)) {
+		if (!length) {
+			break;
+		}
+		const auto till = from + length;
+		if (index == 3) {
+			return std::make_pair(from, till);
+		} else if (At(text, till) == '.') {
+			if (const auto result = MatchOctets(text, till + 1, index + 1)) {
+				return result;
+			}
+		}
+	}
+	return std::nullopt;
+}
+
+[[nodiscard]] LinkMatch MatchLink(
+		QStringView text,
+		qsizetype start,
+		LinkKind kind) {
+	const auto host = SkipProtocol(text, start);
+	if (host == start && kind != LinkKind::Domain) {
+		return {};
+	} else if (kind == LinkKind::IpExplicit) {
+		const auto octet = MatchOctets(text, host, 0);
+		return octet
+			? FillMatch(text, start, host, octet->first, octet->second)
+			: LinkMatch();
+	}
+	return MatchDomain(
+		text,
+		start,
+		host,
+		(kind == LinkKind::Domain) ? 1 : 0);
+}
+
+// Each match has a '.' or "://" after a run of label chars it starts
+// with, so candidates are only checked near those, found by the
+// vectorized QStringView::indexOf().
+[[nodiscard]] LinkMatch FindLink(
+		QStringView text,
+		qsizetype offset,
+		LinkKind kind) {
+	auto dot = (kind == LinkKind::Domain) ? qsizetype(-2) : text.size();
+	auto colon = qsizetype(-2);
+	for (auto from = offset; from < text.size();) {
+		if (dot != text.size() && dot < from) {
+			dot = text.indexOf(QChar('.'), from);
+			if (dot < 0) {
+				dot = text.size();
+			}
+		}
+		if (colon != text.size() && colon < from) {
+			colon = text.indexOf(QChar(':'), from);
+			if (colon < 0) {
+				colon = text.size();
+			}
+		}
+		const auto separator = std::min(dot, colon);
+		if (separator == text.size()) {
+			break;
+		}
+		// Label chars are all \w or [\-\_], so the only start to check
+		// is the beginning of the run, others fail the lookbehind.
+		auto start = separator;
+		while (start > from && IsLabelChar(At(text, start - 1))) {
+			--start;
+		}
+		if (start < separator && GoodLinkStart(text, start)) {
+			if (auto result = MatchLink(text, start, kind)) {
+				return result;
+			}
+		}
+		from = separator + 1;
+	}
+	return {};
+}
+
+[[nodiscard]] int HexValue(QChar ch) {
+	const auto code = ch.unicode();
+	return (code >= '0' && code <= '9')
+		? (code - '0')
+		: (code >= 'a' && code <= 'f')
+		? (code - 'a' + 10)
+		: (code >= 'A' && code <= 'F')
+		? (code - 'A' + 10)
+		: -1;
+}
+
 } // namespace
 
 const QRegularExpression &RegExpDomain() {
@@ -54,6 +372,18 @@ QRegularExpression RegExpProtocol() {
 	return result;
 }
 
+LinkMatch FindDomain(QStringView text, qsizetype offset) {
+	return FindLink(text, offset, LinkKind::Domain);
+}
+
+LinkMatch FindDomainExplicit(QStringView text, qsizetype offset) {
+	return FindLink(text, offset, LinkKind::DomainExplicit);
+}
+
+LinkMatch FindIpExplicit(QStringView text, qsizetype offset) {
+	return FindLink(text, offset, LinkKind::IpExplicit);
+}
+
 bool IsGoodProtocol(const QString &protocol) {
 	const auto equals = [&](QLatin1String string) {
 		return protocol.compare(string, Qt::CaseInsensitive) == 0;
@@ -70,30 +400,114 @@ QMap<QString, QString> url_parse_params(
 		UrlParamNameTransform transform) {
 	auto result = QMap<QString, QString>();
 
-	const auto transformParamName = [transform](const QString &name) {
-		if (transform == UrlParamNameTransform::ToLower) {
-			return name.toLower();
+	auto buffer = QString();
+	for (const auto &[name, rawValue] : UrlParams(params)) {
+		const auto paramName = (transform == UrlParamNameTransform::ToLower)
+			? name.toString().toLower()
+			: name.toString();
+		if (!result.contains(paramName)) {
+			result.insert(
+				paramName,
+				url_decode(rawValue, buffer).toString());
 		}
-		return name;
-	};
-	for (const auto &param : params.split('&')) {
-		// Skip params without a name (starting with '=').
-		if (auto separatorPosition = param.indexOf('=')) {
-			const auto paramName = transformParamName(
-				(separatorPosition > 0)
-					? param.mid(0, separatorPosition)
-					: param);
-			const auto paramValue = (separatorPosition > 0)
-				? url_decode(param.mid(separatorPosition + 1))
-				: QString();
-			if (!result.contains(paramName)) {
-				result.insert(paramName, paramValue);
-			}
+	}
+	return result;
+}
+
+base::flat_map<QString, QString> url_parse_params_flat(
+		QStringView params,
+		UrlParamNameTransform transform) {
+	auto result = base::flat_map<QString, QString>();
+
+	auto buffer = QString();
+	for (const auto &[name, rawValue] : UrlParams(params)) {
+		auto paramName = (transform == UrlParamNameTransform::ToLower)
+			? name.toString().toLower()
+			: name.toString();
+		if (!result.contains(paramName)) {
+			result.emplace(
+				std::move(paramName),
+				url_decode(rawValue, buffer).toString());
 		}
 	}
 	return result;
 }
 
+UrlParams::iterator::iterator(QStringView params)
+: _params(params)
+, _next(0) {
+	advance();
+}
+
+void UrlParams::iterator::advance() {
+	// Like in QString::split('&') empty params are kept.
+	const auto size = _params.size();
+	while (_next >= 0 && _next <= size) {
+		const auto from = _params.begin() + _next;
+		const auto till = std::find(from, _params.end(), QChar('&'));
+		const auto param = _params.mid(_next, till - from);
+		_next += param.size() + 1;
+		const auto separator = std::find(
+			param.begin(),
+			param.end(),
+			QChar('='));
+		if (separator == param.begin() && !param.isEmpty()) {
+			continue;
+		}
+		const auto length = separator - param.begin();
+		_current = UrlParam{
+			.name = param.mid(0, length),
+			.rawValue = (separator != param.end())
+				? param.mid(length + 1)
+				: QStringView(),
+		};
+		return;
+	}
+	_next = -1;
+}
+
+QStringView url_decode(QStringView encoded, QString &buffer) {
+	auto plain = true;
+	for (const auto ch : encoded) {
+		if (ch.unicode() >= 0x80) {
+			// Let Qt handle the UTF-8 round trip.
+			buffer = url_decode(encoded.toString());
+			return buffer;
+		} else if (ch.unicode() == '%' || ch.unicode() == '+') {
+			plain = false;
+		}
+	}
+	if (plain) {
+		return encoded;
+	}
+	buffer.resize(encoded.size());
+	auto to = buffer.data();
+	for (auto i = qsizetype(0), size = encoded.size(); i != size; ++i) {
+		const auto ch = encoded[i];
+		if (ch.unicode() == '+') {
+			*to++ = QChar(' ');
+		} else if (ch.unicode() != '%') {
+			*to++ = ch;
+		} else {
+			const auto full = (i + 2 < size);
+			const auto high = full ? HexValue(encoded[i + 1]) : -1;
+			const auto low = full ? HexValue(encoded[i + 2]) : -1;
+			const auto code = (high >= 0 && low >= 0)
+				? ((high << 4) | low)
+				: -1;
+			if (code <= 0 || code >= 0x80) {
+				// Bad escapes, zero bytes and UTF-8 sequences.
+				buffer = url_decode(encoded.toString());
+				return buffer;
+			}
+			*to++ = QChar(code);
+			i += 2;
+		}
+	}
+	buffer.resize(to - buffer.data());
+	return buffer;
+}
+
 bool is_ipv6(const QString &ip) {
 	//static const auto regexp = QRegularExpression("^[a-fA-F0-9:]+$");
 	//return regexp.match(ip).hasMatch();
@@ -116,20 +530,19 @@ QString validate_url(const QString &value) {
 	if (trimmed.isEmpty()) {
 		return QString();
 	}
-	const auto domainMatch = RegExpDomainExplicit().match(trimmed);
-	const auto ipMatch = RegExpIpExplicit().match(trimmed);
-	if (!domainMatch.hasMatch() && !ipMatch.hasMatch()) {
-		const auto domain = RegExpDomain().match(trimmed);
-		if (!domain.hasMatch() || domain.capturedStart() != 0) {
+	const auto domainMatch = FindDomainExplicit(trimmed);
+	const auto ipMatch = FindIpExplicit(trimmed);
+	if (!domainMatch && !ipMatch) {
+		const auto domain = FindDomain(trimmed);
+		if (!domain || domain.start != 0) {
 			return QString();
 		}
 		return qstr("http://") + trimmed;
-	} else if (domainMatch.capturedStart() != 0 && ipMatch.capturedStart() != 0) {
+	} else if (domainMatch.start != 0 && ipMatch.start != 0) {
 		return QString();
 	}
-	const auto protocolMatch = RegExpProtocol().match(trimmed);
-	Assert(protocolMatch.hasMatch());
-	return IsGoodProtocol(protocolMatch.captured(1)) ? trimmed : QString();
+	const auto &match = (domainMatch.start == 0) ? domainMatch : ipMatch;
+	return IsGoodProtocol(match.protocol.toString()) ? trimmed : QString();
 }
 
 } // namespace qthelp
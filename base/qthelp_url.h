@@ -6,6 +6,8 @@
 //
 #pragma once
 
+#include "base/flat_map.h"
+
 #include <QtCore/QUrl>
 #include <QtCore/QString>
 #include <QtCore/QRegularExpression>
@@ -14,7 +16,31 @@ namespace qthelp {
 
 const QRegularExpression &RegExpDomain();
 const QRegularExpression &RegExpDomainExplicit();
+const QRegularExpression &RegExpIpExplicit();
 QRegularExpression RegExpProtocol();
+
+struct LinkMatch {
+	qsizetype start = -1;
+	qsizetype length = 0;
+	QStringView protocol; // Null if not specified.
+	QStringView domain; // Together with the port.
+	QStringView tld; // The last octet for an ip.
+	QStringView port; // With ':', null if not specified.
+
+	explicit operator bool() const {
+		return (start >= 0);
+	}
+};
+
+// Same matches and captures as RegExpDomain().match(text, offset) and
+// others give, found by a hand-written scanner instead of the regexps.
+[[nodiscard]] LinkMatch FindDomain(QStringView text, qsizetype offset = 0);
+[[nodiscard]] LinkMatch FindDomainExplicit(
+	QStringView text,
+	qsizetype offset = 0);
+[[nodiscard]] LinkMatch FindIpExplicit(
+	QStringView text,
+	qsizetype offset = 0);
 [[nodiscard]] bool IsGoodProtocol(const QString &protocol);
 
 inline QString url_encode(const QString &part) {
@@ -33,6 +59,87 @@ enum class UrlParamNameTransform {
 QMap<QString, QString> url_parse_params(
 	const QString &params,
 	UrlParamNameTransform transform = UrlParamNameTransform::NoTransform);
+[[nodiscard]] base::flat_map<QString, QString> url_parse_params_flat(
+	QStringView params,
+	UrlParamNameTransform transform = UrlParamNameTransform::NoTransform);
+
+struct UrlParam {
+	QStringView name;
+	QStringView rawValue;
+};
+
+// Iterates "p1=v1&p2=v2&..&pn=vn" without copying anything,
+// skipping the params without a name (starting with '=').
+class UrlParams final {
+public:
+	class iterator final {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = UrlParam;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const UrlParam*;
+		using reference = const UrlParam&;
+
+		iterator() = default;
+
+		[[nodiscard]] reference operator*() const {
+			return _current;
+		}
+		[[nodiscard]] pointer operator->() const {
+			return &_current;
+		}
+		iterator &operator++() {
+			advance();
+			return *this;
+		}
+		iterator operator++(int) {
+			auto result = *this;
+			advance();
+			return result;
+		}
+
+		friend inline bool operator==(
+				const iterator &a,
+				const iterator &b) {
+			return (a._next == b._next);
+		}
+		friend inline bool operator!=(
+				const iterator &a,
+				const iterator &b) {
+			return !(a == b);
+		}
+
+	private:
+		friend class UrlParams;
+
+		explicit iterator(QStringView params);
+
+		void advance();
+
+		QStringView _params;
+		UrlParam _current;
+		qsizetype _next = -1; // After the current param, -1 at the end.
+
+	};
+
+	explicit UrlParams(QStringView params) : _params(params) {
+	}
+
+	[[nodiscard]] iterator begin() const {
+		return iterator(_params);
+	}
+	[[nodiscard]] iterator end() const {
+		return iterator();
+	}
+
+private:
+	QStringView _params;
+
+};
+
+// Same as url_decode(), but reuses the buffer, returning a view into
+// it or into the encoded value itself when there is nothing to decode.
+[[nodiscard]] QStringView url_decode(QStringView encoded, QString &buffer);
 
 QString url_append_query_or_hash(const QString &url, const QString &add);
 
@@ -0,0 +1,130 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/qthelp_url.h"
+
+#include <random>
+
+namespace {
+
+using FindMethod = qthelp::LinkMatch(*)(QStringView, qsizetype);
+
+struct Groups {
+	int protocol = 0;
+	int domain = 0;
+	int tld = 0;
+	int port = 0;
+};
+
+void CheckCapture(
+		const QRegularExpressionMatch &expected,
+		int group,
+		const QString &text,
+		QStringView captured) {
+	if (expected.capturedStart(group) < 0) {
+		REQUIRE(captured.isNull());
+	} else {
+		REQUIRE(!captured.isNull());
+		REQUIRE(captured.data() - text.data() == expected.capturedStart(group));
+		REQUIRE(captured.size() == expected.capturedLength(group));
+	}
+}
+
+void CheckAllMatches(
+		const QRegularExpression &regexp,
+		FindMethod find,
+		Groups groups,
+		const QString &text) {
+	auto offset = qsizetype(0);
+	while (true) {
+		const auto expected = regexp.match(text, offset);
+		const auto found = find(text, offset);
+		INFO(text.toStdString());
+		REQUIRE(expected.hasMatch() == bool(found));
+		if (!found) {
+			break;
+		}
+		REQUIRE(found.start == expected.capturedStart());
+		REQUIRE(found.length == expected.capturedLength());
+		CheckCapture(expected, groups.protocol, text, found.protocol);
+		CheckCapture(expected, groups.domain, text, found.domain);
+		CheckCapture(expected, groups.tld, text, found.tld);
+		CheckCapture(expected, groups.port, text, found.port);
+		offset = found.start + std::max(found.length, qsizetype(1));
+	}
+}
+
+void Fuzz(const std::vector<QString> &pieces, int maxPieces, int count) {
+	const auto domain = Groups{ 1, 2, 3, 4 };
+	const auto ip = Groups{ 1, 2, 5, 6 };
+	auto generator = std::mt19937(count);
+	for (auto i = 0; i != count; ++i) {
+		auto text = QString();
+		for (auto j = int(generator() % maxPieces); j != 0; --j) {
+			text += pieces[generator() % pieces.size()];
+		}
+		CheckAllMatches(
+			qthelp::RegExpDomain(),
+			qthelp::FindDomain,
+			domain,
+			text);
+		CheckAllMatches(
+			qthelp::RegExpDomainExplicit(),
+			qthelp::FindDomainExplicit,
+			domain,
+			text);
+		CheckAllMatches(
+			qthelp::RegExpIpExplicit(),
+			qthelp::FindIpExplicit,
+			ip,
+			text);
+	}
+}
+
+[[nodiscard]] std::vector<QString> Pieces(std::vector<const char*> list) {
+	auto result = std::vector<QString>();
+	for (const auto piece : list) {
+		result.push_back(QString::fromUtf8(piece));
+	}
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("link scanner matches the regexps", "[qthelp]") {
+	SECTION("short pieces with all the char classes") {
+		Fuzz(Pieces({
+			"a", "b", "z", "Q", "h", "t", "p", "s",
+			"0", "1", "2", "3", "4", "5", "9",
+			".", ".", ".", ":", "://", "://", "/",
+			"-", "_", "$", "%", "=", " ", " ",
+			"\xD0\xB0", "\xD1\x8F", "\xD1\x91", "\xD0\x81", // а я ё Ё
+			"\xD1\x80", "\xD1\x84", "\xD1\x97", // р ф ї
+			"\xD9\xA3", // Arabic-Indic digit three.
+			"\xF0\x9D\x9F\x8E", // Mathematical bold digit zero.
+			"\xC3\xA9", "\xF0\x9F\x98\x80", "\xE2\x85\xA0", "\xCC\x81",
+			"http", "com", "255", "256", "25", "199",
+		}), 30, 100000);
+	}
+	SECTION("long labels and top level domains") {
+		Fuzz(Pieces({
+			"a.", "ab.", "x", "abcdefghij", "0123456789",
+			"\xF0\x9D\x9F\x8E", "\xF0\x9D\x9F\x8E\xF0\x9D\x9F\x8E",
+			":1", ":", "\xD9\xA3", " ", "http://", "-", "1.", "255.", "2",
+		}), 60, 100000);
+	}
+}
+
+TEST_CASE("validate_url", "[qthelp]") {
+	REQUIRE(qthelp::validate_url("telegram.org") == "http://telegram.org");
+	REQUIRE(qthelp::validate_url(" https://t.me/x ") == "https://t.me/x");
+	REQUIRE(qthelp::validate_url("tg://resolve") == "tg://resolve");
+	REQUIRE(qthelp::validate_url("http://127.0.0.1:8") == "http://127.0.0.1:8");
+	REQUIRE(qthelp::validate_url("ftp://example.com").isEmpty());
+	REQUIRE(qthelp::validate_url("not a link").isEmpty());
+}
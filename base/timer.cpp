@@ -27,6 +27,7 @@ void CheckLocalTime() {
 		base::ConcurrentTimerEnvironment::Adjust();
 		base::unixtime::http_invalidate();
 	}
+	base::unixtime::update_local_offsets();
 }
 
 Timer::Timer(
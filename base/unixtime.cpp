@@ -7,7 +7,10 @@
 #include "base/unixtime.h"
 
 #include <QDateTime>
-#include <QReadWriteLock>
+
+#include <ctime>
+#include <mutex>
+#include <thread>
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -22,12 +25,32 @@ namespace unixtime {
 namespace {
 
 constexpr auto kIgnoreTimeDifference = TimeId(3);
+constexpr auto kCoarseTickDelay = std::chrono::milliseconds(20);
+constexpr auto kSecondsInDay = int64(86400);
+
+// Time zone offsets are multiples of 15 minutes, so they change only
+// on the quarter hour boundaries of UTC. Each cache entry holds
+// [bucket : 32][generation : 14][offset + kOffsetBias : 18].
+constexpr auto kOffsetBucket = int64(900);
+constexpr auto kOffsetCacheSize = 256;
+constexpr auto kOffsetBias = 65536;
+constexpr auto kOffsetGenerations = 0x3FFF;
+constexpr auto kLocalZoneCheckDelay = crl::time(1000);
 
 std::atomic<bool> ValueUpdated/* = false*/;
 std::atomic<TimeId> ValueShift/* = 0*/;
 std::atomic<bool> HttpValueValid/* = false*/;
 std::atomic<TimeId> HttpValueShift/* = 0*/;
-
+std::atomic<TimeId> CoarseValue/* = 0*/;
+std::atomic<bool> CoarseTicking/* = false*/;
+std::atomic<uint64> OffsetCache[kOffsetCacheSize];
+std::atomic<uint32> OffsetGeneration/* = 0*/;
+std::atomic<uint64> LocalZone/* = 0*/;
+std::atomic<crl::time> LocalZoneChecked/* = 0*/;
+
+// Ids are strictly increasing and unique across threads between the
+// time updates. The start point is published through a seqlock, so
+// next() doesn't take any locks, only a single CAS on the last id.
 class MsgIdManager {
 public:
 	MsgIdManager();
@@ -38,33 +61,47 @@ public:
 private:
 	void initialize();
 
-	QReadWriteLock _lock;
-	uint64 _startId = 0;
-	std::atomic<uint32> _incrementedPart = 0;
-	uint64 _startCounter = 0;
+	std::mutex _updateMutex;
+	std::atomic<uint32> _version = 0; // Odd while being updated.
+	std::atomic<uint64> _startId = 0;
+	std::atomic<uint64> _startCounter = 0;
+	std::atomic<uint64> _lastId = 0;
 	const uint64 _randomPart = 0;
-	const float64 _multiplier = 0.;
+	const uint64 _multiplier = 0; // Fixed point 32.32.
 
 };
 
 MsgIdManager GlobalMsgIdManager;
 
-[[nodiscard]] float64 GetMultiplier() {
+[[nodiscard]] uint64 GetMultiplier() {
 	// 0xFFFF0000 instead of 0x100000000 to make msgId grow slightly slower,
 	// than unixtime and we had time to reconfigure.
 
 #ifdef Q_OS_WIN
 	LARGE_INTEGER li;
 	QueryPerformanceFrequency(&li);
-	return float64(0xFFFF0000L) / float64(li.QuadPart);
+	const auto result = float64(0xFFFF0000L) / float64(li.QuadPart);
 #elif defined Q_OS_MAC // Q_OS_WIN
 	mach_timebase_info_data_t tb = { 0, 0 };
 	mach_timebase_info(&tb);
 	const auto frequency = (float64(tb.numer) / tb.denom) / 1000000.;
-	return frequency * (float64(0xFFFF0000L) / 1000.);
+	const auto result = frequency * (float64(0xFFFF0000L) / 1000.);
 #else // Q_OS_MAC || Q_OS_WIN
-	return float64(0xFFFF0000L) / 1000000000.;
+	const auto result = float64(0xFFFF0000L) / 1000000000.;
 #endif // Q_OS_MAC || Q_OS_WIN
+	return uint64(std::llround(result * float64(1ULL << 32)));
+}
+
+// Exact floor(value * multiplier / 2^32) while the result fits 64 bits.
+[[nodiscard]] uint64 MultiplyFixed(uint64 value, uint64 multiplier) {
+	const auto valueLow = value & 0xFFFFFFFFULL;
+	const auto valueHigh = value >> 32;
+	const auto multiplierLow = multiplier & 0xFFFFFFFFULL;
+	const auto multiplierHigh = multiplier >> 32;
+	return ((valueHigh * multiplierHigh) << 32)
+		+ valueHigh * multiplierLow
+		+ valueLow * multiplierHigh
+		+ ((valueLow * multiplierLow) >> 32);
 }
 
 [[nodiscard]] uint64 GetCounter() {
@@ -96,33 +133,184 @@ MsgIdManager::MsgIdManager()
 }
 
 void MsgIdManager::update() {
-	QWriteLocker lock(&_lock);
+	std::lock_guard<std::mutex> lock(_updateMutex);
 	initialize();
 }
 
 void MsgIdManager::initialize() {
-	_startCounter = GetCounter();
-	_startId = ((uint64(uint32(now()))) << 32) | _randomPart;
+	const auto version = _version.load(std::memory_order_relaxed);
+	_version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	_startCounter.store(GetCounter(), std::memory_order_relaxed);
+	_startId.store(
+		((uint64(uint32(now()))) << 32) | _randomPart,
+		std::memory_order_relaxed);
+
+	// _lastId is kept, so that ids stay increasing if time went backwards.
+	_version.store(version + 2, std::memory_order_release);
 }
 
 uint64 MsgIdManager::next() {
-	const auto counter = GetCounter();
+	auto startCounter = uint64();
+	auto startId = uint64();
+	auto counter = uint64();
+	while (true) {
+		const auto version = _version.load(std::memory_order_acquire);
+		if (version & 1) {
+			continue;
+		}
+		startCounter = _startCounter.load(std::memory_order_relaxed);
+		startId = _startId.load(std::memory_order_relaxed);
+		counter = GetCounter();
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (_version.load(std::memory_order_relaxed) == version) {
+			break;
+		}
+	}
+	const auto delta = (counter - startCounter);
+	const auto computed = (startId + MultiplyFixed(delta, _multiplier))
+		& ~uint64(0x03);
+
+	auto last = _lastId.load(std::memory_order_relaxed);
+	auto result = uint64();
+	do {
+		result = std::max(computed, last + 4);
+	} while (!_lastId.compare_exchange_weak(
+		last,
+		result,
+		std::memory_order_relaxed));
+	return result;
+}
+
+TimeId local() {
+	return (TimeId)time(nullptr);
+}
 
-	QReadLocker lock(&_lock);
-	const auto startCounter = _startCounter;
-	const auto startId = _startId;
-	lock.unlock();
+void RefreshCoarse() {
+	CoarseValue.store(local() + ValueShift.load(), std::memory_order_relaxed);
+}
 
-	const auto incrementedPart = (_incrementedPart += 4);
+// Started on the first coarse request, wakes up once a second
+// right after the second changes. The delay covers the system
+// clock tick, time() itself may be based on a coarse clock.
+void StartCoarseTicker() {
+	if (CoarseTicking.exchange(true)) {
+		return;
+	}
+	RefreshCoarse();
+	std::thread([] {
+		using namespace std::chrono;
+		while (true) {
+			const auto since = system_clock::now().time_since_epoch();
+			const auto tail = since - duration_cast<seconds>(since);
+			std::this_thread::sleep_for(seconds(1) - tail + kCoarseTickDelay);
+			RefreshCoarse();
+		}
+	}).detach();
+}
 
-	const auto delta = (counter - startCounter);
-	const auto result = startId + (uint64)floor(delta * _multiplier);
+[[nodiscard]] int64 FloorDivide(int64 value, int64 divider) {
+	return (value >= 0)
+		? (value / divider)
+		: -((-value + divider - 1) / divider);
+}
 
-	return (result & ~0x03L) + incrementedPart;
+// See http://howardhinnant.github.io/date_algorithms.html
+[[nodiscard]] int64 DaysFromCivil(int64 year, int month, int day) {
+	year -= (month <= 2) ? 1 : 0;
+	const auto era = FloorDivide(year, 400);
+	const auto yearOfEra = year - era * 400;
+	const auto dayOfYear = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5
+		+ day
+		- 1;
+	const auto dayOfEra = yearOfEra * 365
+		+ yearOfEra / 4
+		- yearOfEra / 100
+		+ dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
 }
 
-TimeId local() {
-	return (TimeId)time(nullptr);
+[[nodiscard]] CivilTime CivilFromSeconds(int64 seconds) {
+	const auto days = FloorDivide(seconds, kSecondsInDay);
+	const auto time = int(seconds - days * kSecondsInDay);
+	const auto shifted = days + 719468;
+	const auto era = FloorDivide(shifted, 146097);
+	const auto dayOfEra = shifted - era * 146097;
+	const auto yearOfEra = (dayOfEra
+		- dayOfEra / 1460
+		+ dayOfEra / 36524
+		- dayOfEra / 146096) / 365;
+	const auto dayOfYear = dayOfEra
+		- (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	const auto monthPosition = (5 * dayOfYear + 2) / 153;
+	const auto month = int(monthPosition + ((monthPosition < 10) ? 3 : -9));
+	return {
+		.year = int(yearOfEra + era * 400 + ((month <= 2) ? 1 : 0)),
+		.month = month,
+		.day = int(dayOfYear - (153 * monthPosition + 2) / 5 + 1),
+		.hour = time / 3600,
+		.minute = (time / 60) % 60,
+		.second = time % 60,
+		.dayOfWeek = int(days + 3 - FloorDivide(days + 3, 7) * 7) + 1,
+	};
+}
+
+[[nodiscard]] int ComputeLocalOffset(int64 value) {
+	const auto time = time_t(value);
+	auto parts = tm();
+#ifdef Q_OS_WIN
+	if (localtime_s(&parts, &time) != 0) {
+		return 0;
+	}
+#else // Q_OS_WIN
+	if (!localtime_r(&time, &parts)) {
+		return 0;
+	}
+#endif // Q_OS_WIN
+	const auto local = DaysFromCivil(
+		parts.tm_year + 1900,
+		parts.tm_mon + 1,
+		parts.tm_mday) * kSecondsInDay
+		+ parts.tm_hour * 3600
+		+ parts.tm_min * 60
+		+ parts.tm_sec;
+	return int(local - value);
+}
+
+// UTC offset of the local time zone at the given moment of UTC.
+[[nodiscard]] int LocalOffset(int64 value) {
+	const auto bucket = uint32(FloorDivide(value, kOffsetBucket));
+	const auto generation = 1 + uint64(
+		OffsetGeneration.load(std::memory_order_relaxed) % kOffsetGenerations);
+	auto &slot = OffsetCache[bucket % kOffsetCacheSize];
+	const auto entry = slot.load(std::memory_order_relaxed);
+	if ((entry >> 32) == bucket && ((entry >> 18) & 0x3FFF) == generation) {
+		return int(entry & 0x3FFFF) - kOffsetBias;
+	}
+	const auto offset = ComputeLocalOffset(value);
+	slot.store(
+		(uint64(bucket) << 32)
+			| (generation << 18)
+			| uint64(offset + kOffsetBias),
+		std::memory_order_relaxed);
+	return offset;
+}
+
+void ReadLocalZone() {
+#ifdef Q_OS_WIN
+	_tzset();
+#else // Q_OS_WIN
+	tzset();
+#endif // Q_OS_WIN
+}
+
+// Offsets now and in half a year, so that a zone change is noticed
+// even when it differs only in the daylight saving time.
+[[nodiscard]] uint64 LocalZoneFingerprint() {
+	const auto now = int64(time(nullptr));
+	const auto later = now + 183 * kSecondsInDay;
+	return (uint64(uint32(ComputeLocalOffset(now))) << 32)
+		| uint64(uint32(ComputeLocalOffset(later)));
 }
 
 rpl::event_stream<> &UpdatesStream() {
@@ -132,7 +320,13 @@ rpl::event_stream<> &UpdatesStream() {
 
 } // namespace
 
-TimeId now() {
+TimeId now(Clock clock) {
+	if (clock == Clock::Coarse) {
+		if (const auto value = CoarseValue.load(std::memory_order_relaxed)) {
+			return value;
+		}
+		StartCoarseTicker();
+	}
 	return local() + ValueShift.load();
 }
 
@@ -160,6 +354,9 @@ void update(TimeId now, bool force) {
 	HttpValueValid = false;
 
 	if (old != shift) {
+		if (CoarseTicking) {
+			RefreshCoarse();
+		}
 		GlobalMsgIdManager.update();
 
 		crl::on_main([] {
@@ -182,6 +379,48 @@ TimeId serialize(const QDateTime &date) {
 	return date.isNull() ? TimeId(0) : date.toSecsSinceEpoch() + ValueShift;
 }
 
+CivilTime parse_civil(TimeId value) {
+	const auto utc = int64(value) - ValueShift;
+	return CivilFromSeconds(utc + LocalOffset(utc));
+}
+
+TimeId serialize_civil(const CivilTime &local) {
+	const auto seconds = DaysFromCivil(local.year, local.month, local.day)
+		* kSecondsInDay
+		+ local.hour * 3600
+		+ local.minute * 60
+		+ local.second;
+
+	// The offset is taken at the guessed moment, so the second pass
+	// fixes the moments near the transitions.
+	const auto guess = seconds - LocalOffset(seconds);
+	return TimeId(seconds - LocalOffset(guess) + ValueShift);
+}
+
+void invalidate_local_offsets() {
+	ReadLocalZone();
+	LocalZone = LocalZoneFingerprint();
+	LocalZoneChecked = crl::now();
+	++OffsetGeneration;
+}
+
+void update_local_offsets() {
+	update_local_offsets(crl::now());
+}
+
+void update_local_offsets(crl::time now) {
+	const auto checked = LocalZoneChecked.load(std::memory_order_relaxed);
+	if (checked && now >= checked && now - checked < kLocalZoneCheckDelay) {
+		return;
+	}
+	LocalZoneChecked.store(now, std::memory_order_relaxed);
+	ReadLocalZone();
+	const auto zone = LocalZoneFingerprint();
+	if (LocalZone.exchange(zone) != zone) {
+		++OffsetGeneration;
+	}
+}
+
 bool http_valid() {
 	return HttpValueValid;
 }
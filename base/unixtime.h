@@ -8,6 +8,8 @@
 
 #include "base/basic_types.h"
 
+#include <crl/crl_time.h>
+
 class QDateTime;
 
 namespace base {
@@ -15,13 +17,41 @@ namespace unixtime {
 
 // All functions are thread-safe.
 
-[[nodiscard]] TimeId now();
+enum class Clock {
+	Precise, // Reads the system clock on each call.
+	Coarse, // A single atomic load, may lag behind by up to 20 ms.
+};
+
+[[nodiscard]] TimeId now(Clock clock = Clock::Precise);
 void update(TimeId now, bool force = false);
 [[nodiscard]] rpl::producer<> updates(); // main thread
 
 [[nodiscard]] QDateTime parse(TimeId value);
 [[nodiscard]] TimeId serialize(const QDateTime &date);
 
+struct CivilTime {
+	int year = 0;
+	int month = 0; // 1 - 12
+	int day = 0; // 1 - 31
+	int hour = 0;
+	int minute = 0;
+	int second = 0;
+	int dayOfWeek = 0; // 1 (Monday) - 7, like in QDate.
+};
+
+// Same as parse() / serialize() in local time, without QDateTime.
+// Local time zone offsets are cached until the zone changes.
+[[nodiscard]] CivilTime parse_civil(TimeId value);
+[[nodiscard]] TimeId serialize_civil(const CivilTime &local);
+
+// Drops the cached offsets unconditionally.
+void invalidate_local_offsets();
+
+// Re-reads the zone at most once a second, drops the cached offsets
+// only if the zone has changed.
+void update_local_offsets();
+void update_local_offsets(crl::time now);
+
 [[nodiscard]] bool http_valid();
 [[nodiscard]] TimeId http_now();
 void http_update(TimeId now);
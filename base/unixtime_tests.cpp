@@ -0,0 +1,230 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/unixtime.h"
+
+#include <QtCore/QDateTime>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+[[nodiscard]] std::vector<std::vector<uint64>> GenerateMsgIds(
+		int threads,
+		int count) {
+	auto result = std::vector<std::vector<uint64>>(threads);
+	auto workers = std::vector<std::thread>();
+	for (auto &ids : result) {
+		workers.emplace_back([&ids, count] {
+			ids.reserve(count);
+			for (auto i = 0; i != count; ++i) {
+				ids.push_back(base::unixtime::mtproto_msg_id());
+			}
+		});
+	}
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	return result;
+}
+
+void SetTimeZoneVariable(const char *zone) {
+#ifdef Q_OS_WIN
+	_putenv_s("TZ", zone);
+#else // Q_OS_WIN
+	setenv("TZ", zone, 1);
+#endif // Q_OS_WIN
+}
+
+void UnsetTimeZoneVariable() {
+#ifdef Q_OS_WIN
+	_putenv_s("TZ", "");
+#else // Q_OS_WIN
+	unsetenv("TZ");
+#endif // Q_OS_WIN
+}
+
+void SetTimeZone(const char *zone) {
+	SetTimeZoneVariable(zone);
+	base::unixtime::invalidate_local_offsets();
+}
+
+// Restores TZ and drops the offsets cached for the test zones.
+[[nodiscard]] auto TimeZoneGuard() {
+	const auto was = std::getenv("TZ");
+	auto saved = was ? std::make_optional(std::string(was)) : std::nullopt;
+	return gsl::finally([saved = std::move(saved)] {
+		if (saved) {
+			SetTimeZoneVariable(saved->c_str());
+		} else {
+			UnsetTimeZoneVariable();
+		}
+		base::unixtime::invalidate_local_offsets();
+	});
+}
+
+void CheckCivil(TimeId value) {
+	const auto civil = base::unixtime::parse_civil(value);
+	const auto date = base::unixtime::parse(value);
+	REQUIRE(civil.year == date.date().year());
+	REQUIRE(civil.month == date.date().month());
+	REQUIRE(civil.day == date.date().day());
+	REQUIRE(civil.hour == date.time().hour());
+	REQUIRE(civil.minute == date.time().minute());
+	REQUIRE(civil.second == date.time().second());
+	REQUIRE(civil.dayOfWeek == date.date().dayOfWeek());
+}
+
+} // namespace
+
+TEST_CASE("msg ids are strictly increasing and unique", "[unixtime]") {
+	const auto generated = GenerateMsgIds(8, 100000);
+
+	auto all = std::vector<uint64>();
+	for (const auto &ids : generated) {
+		for (auto i = 1; i < int(ids.size()); ++i) {
+			REQUIRE(ids[i - 1] < ids[i]);
+		}
+		REQUIRE(ranges::all_of(ids, [](uint64 id) { return !(id & 3); }));
+		all.insert(end(all), begin(ids), end(ids));
+	}
+	ranges::sort(all);
+	REQUIRE(std::adjacent_find(begin(all), end(all)) == end(all));
+
+	// Ids generated after a join must be greater than all the previous.
+	REQUIRE(base::unixtime::mtproto_msg_id() > all.back());
+}
+
+TEST_CASE("msg ids keep increasing when time goes back", "[unixtime]") {
+	const auto before = base::unixtime::mtproto_msg_id();
+
+	auto generated = std::vector<std::vector<uint64>>();
+	auto generator = std::thread([&] {
+		generated = GenerateMsgIds(4, 100000);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	base::unixtime::update(base::unixtime::now() - 3600, true);
+	generator.join();
+
+	auto all = std::vector<uint64>();
+	for (const auto &ids : generated) {
+		REQUIRE(ids.front() > before);
+		for (auto i = 1; i < int(ids.size()); ++i) {
+			REQUIRE(ids[i - 1] < ids[i]);
+		}
+		all.insert(end(all), begin(ids), end(ids));
+	}
+	ranges::sort(all);
+	REQUIRE(std::adjacent_find(begin(all), end(all)) == end(all));
+	REQUIRE(base::unixtime::mtproto_msg_id() > all.back());
+
+	base::unixtime::update(TimeId(time(nullptr)), true);
+}
+
+TEST_CASE("msg ids follow unixtime", "[unixtime]") {
+	const auto id = base::unixtime::mtproto_msg_id();
+	const auto seconds = TimeId(id >> 32);
+	REQUIRE(std::abs(seconds - base::unixtime::now()) <= 1);
+}
+
+TEST_CASE("civil time matches QDateTime", "[unixtime]") {
+	const auto guard = TimeZoneGuard();
+	SetTimeZone("Europe/Berlin");
+
+	// Around the 2021 transitions at 01:00 UTC.
+	for (const auto transition : { TimeId(1616893200), TimeId(1635642000) }) {
+		const auto till = transition + 7200;
+		for (auto value = transition - 7200; value != till; ++value) {
+			CheckCivil(value);
+		}
+	}
+	for (auto value = TimeId(1); value < TimeId(2000000000); value += 259211) {
+		CheckCivil(value);
+	}
+}
+
+TEST_CASE("civil time round trips", "[unixtime]") {
+	const auto guard = TimeZoneGuard();
+	SetTimeZone("Europe/Berlin");
+
+	// Skip the hour that is repeated in the autumn.
+	const auto till = TimeId(1700000000);
+	for (auto value = TimeId(1600000000); value < till; value += 3593) {
+		const auto civil = base::unixtime::parse_civil(value);
+		if (civil.month == 10 && civil.hour == 2 && civil.day >= 25) {
+			continue;
+		}
+		REQUIRE(base::unixtime::serialize_civil(civil) == value);
+		REQUIRE(base::unixtime::serialize_civil(civil)
+			== base::unixtime::serialize(base::unixtime::parse(value)));
+	}
+}
+
+TEST_CASE("civil time follows time zone changes", "[unixtime]") {
+	const auto guard = TimeZoneGuard();
+	SetTimeZone("Europe/Berlin");
+	const auto summer = TimeId(1690000000);
+	REQUIRE(base::unixtime::parse_civil(summer).hour == 6);
+
+	// The zone is re-read at most once a second.
+	SetTimeZoneVariable("Asia/Tokyo");
+	const auto now = crl::now();
+	base::unixtime::update_local_offsets(now + 500);
+	REQUIRE(base::unixtime::parse_civil(summer).hour == 6);
+	base::unixtime::update_local_offsets(now + 1000);
+	REQUIRE(base::unixtime::parse_civil(summer).hour == 13);
+	CheckCivil(summer);
+}
+
+TEST_CASE("civil time throughput", "[.][unixtime][benchmark]") {
+	using Clock = std::chrono::steady_clock;
+	constexpr auto kCount = 1000000;
+	auto checksum = 0;
+	const auto civilStart = Clock::now();
+	for (auto i = 0; i != kCount; ++i) {
+		checksum += base::unixtime::parse_civil(1700000000 + i * 7).hour;
+	}
+	const auto dateStart = Clock::now();
+	for (auto i = 0; i != kCount; ++i) {
+		checksum += base::unixtime::parse(1700000000 + i * 7).time().hour();
+	}
+	const auto finish = Clock::now();
+	const auto ns = [](auto duration) {
+		return std::chrono::duration<double, std::nano>(duration).count()
+			/ kCount;
+	};
+	std::cout
+		<< "parse_civil: " << ns(dateStart - civilStart) << " ns, "
+		<< "parse: " << ns(finish - dateStart) << " ns "
+		<< "(" << (checksum & 1) << ")"
+		<< std::endl;
+}
+
+TEST_CASE("msg id throughput", "[.][unixtime][benchmark]") {
+	using Clock = std::chrono::steady_clock;
+	constexpr auto kCount = 1000000;
+	for (const auto threads : { 1, 2, 4, 8 }) {
+		const auto start = Clock::now();
+		[[maybe_unused]] const auto ids = GenerateMsgIds(threads, kCount);
+		const auto elapsed = std::chrono::duration<double, std::nano>(
+			Clock::now() - start).count();
+		std::cout
+			<< threads << " threads: "
+			<< (elapsed / kCount) << " ns per id in each thread, "
+			<< (double(kCount) * threads / elapsed * 1000.) << " M ids/s"
+			<< std::endl;
+	}
+}
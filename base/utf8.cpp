@@ -0,0 +1,376 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "base/utf8.h"
+
+#if defined __x86_64__ || defined _M_X64 || defined _M_IX86
+#define BASE_UTF8_SSSE3
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+#include <tmmintrin.h>
+#if defined __GNUC__ || defined __clang__
+#define BASE_UTF8_SSSE3_TARGET __attribute__((target("ssse3")))
+#else // __GNUC__ || __clang__
+#define BASE_UTF8_SSSE3_TARGET
+#endif // __GNUC__ || __clang__
+#elif defined __aarch64__ || defined _M_ARM64
+#define BASE_UTF8_NEON
+#include <arm_neon.h>
+#endif
+
+namespace base {
+namespace {
+
+constexpr auto kBlockSize = 16;
+
+// Lookup tables of the Keiser-Lemire validation algorithm, see
+// "Validating UTF-8 In Less Than One Instruction Per Byte", 2020.
+// Each error kind has a bit set in all three lookups of a byte pair.
+constexpr auto kTooShort = uchar(1 << 0);
+constexpr auto kTooLong = uchar(1 << 1);
+constexpr auto kOverlong3 = uchar(1 << 2);
+constexpr auto kTooLarge = uchar(1 << 3);
+constexpr auto kSurrogate = uchar(1 << 4);
+constexpr auto kOverlong2 = uchar(1 << 5);
+constexpr auto kTooLarge1000 = uchar(1 << 6);
+constexpr auto kOverlong4 = uchar(1 << 6);
+constexpr auto kTwoContinuations = uchar(1 << 7);
+constexpr auto kCarry = uchar(kTooShort | kTooLong | kTwoContinuations);
+
+// By the high nibble of the previous byte.
+constexpr uchar kFirstHigh[kBlockSize] = {
+	kTooLong, kTooLong, kTooLong, kTooLong,
+	kTooLong, kTooLong, kTooLong, kTooLong,
+	kTwoContinuations, kTwoContinuations,
+	kTwoContinuations, kTwoContinuations,
+	kTooShort | kOverlong2,
+	kTooShort,
+	kTooShort | kOverlong3 | kSurrogate,
+	kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+// By the low nibble of the previous byte.
+constexpr uchar kFirstLow[kBlockSize] = {
+	kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+	kCarry | kOverlong2,
+	kCarry,
+	kCarry,
+	kCarry | kTooLarge,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+	kCarry | kTooLarge | kTooLarge1000,
+	kCarry | kTooLarge | kTooLarge1000,
+};
+
+// By the high nibble of the current byte.
+constexpr uchar kSecondHigh[kBlockSize] = {
+	kTooShort, kTooShort, kTooShort, kTooShort,
+	kTooShort, kTooShort, kTooShort, kTooShort,
+	(kTooLong | kOverlong2 | kTwoContinuations
+		| kOverlong3 | kTooLarge1000 | kOverlong4),
+	(kTooLong | kOverlong2 | kTwoContinuations
+		| kOverlong3 | kTooLarge),
+	(kTooLong | kOverlong2 | kTwoContinuations
+		| kSurrogate | kTooLarge),
+	(kTooLong | kOverlong2 | kTwoContinuations
+		| kSurrogate | kTooLarge),
+	kTooShort, kTooShort, kTooShort, kTooShort,
+};
+
+// Bytes greater than these at the end start an incomplete sequence.
+constexpr uchar kIncompleteMax[kBlockSize] = {
+	255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+// Returns the size of a valid sequence or zero.
+[[nodiscard]] int SequenceSize(const uchar *from, const uchar *till) {
+	const auto first = from[0];
+	const auto continuation = [&](int index, uchar min, uchar max) {
+		return (from + index < till)
+			&& (from[index] >= min)
+			&& (from[index] <= max);
+	};
+	if (first < 0x80) {
+		return 1;
+	} else if (first < 0xC2) {
+		return 0;
+	} else if (first < 0xE0) {
+		return continuation(1, 0x80, 0xBF) ? 2 : 0;
+	} else if (first < 0xF0) {
+		const auto min = (first == 0xE0) ? uchar(0xA0) : uchar(0x80);
+		const auto max = (first == 0xED) ? uchar(0x9F) : uchar(0xBF);
+		return (continuation(1, min, max) && continuation(2, 0x80, 0xBF))
+			? 3
+			: 0;
+	} else if (first < 0xF5) {
+		const auto min = (first == 0xF0) ? uchar(0x90) : uchar(0x80);
+		const auto max = (first == 0xF4) ? uchar(0x8F) : uchar(0xBF);
+		return (continuation(1, min, max)
+			&& continuation(2, 0x80, 0xBF)
+			&& continuation(3, 0x80, 0xBF))
+			? 4
+			: 0;
+	}
+	return 0;
+}
+
+[[maybe_unused]] [[nodiscard]] Utf8Validation ValidateScalar(
+		const uchar *from,
+		const uchar *till) {
+	auto result = Utf8Validation{ .valid = true };
+	while (from != till) {
+		// Skip ASCII eight bytes at a time.
+		while (till - from >= 8) {
+			auto word = uint64();
+			memcpy(&word, from, sizeof(word));
+			if (word & 0x8080808080808080ULL) {
+				break;
+			}
+			from += 8;
+			result.utf16Length += 8;
+		}
+		if (from == till) {
+			break;
+		}
+		const auto size = SequenceSize(from, till);
+		if (!size) {
+			return {};
+		}
+		from += size;
+		result.utf16Length += (size == 4) ? 2 : 1;
+	}
+	return result;
+}
+
+#ifdef BASE_UTF8_SSSE3
+
+[[nodiscard]] bool HasSsse3() {
+#ifdef _MSC_VER
+	int info[4] = { 0 };
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else // _MSC_VER
+	return __builtin_cpu_supports("ssse3");
+#endif // _MSC_VER
+}
+
+// Counters are kept in bytes and summed before they could overflow.
+constexpr auto kFlushCountersEach = 255;
+
+struct Ssse3State {
+	__m128i error = _mm_setzero_si128();
+	__m128i previous = _mm_setzero_si128();
+	__m128i incomplete = _mm_setzero_si128();
+	__m128i continuations = _mm_setzero_si128();
+	__m128i fourByteLeads = _mm_setzero_si128();
+	int counted = 0;
+	qsizetype utf16Shrink = 0;
+};
+
+BASE_UTF8_SSSE3_TARGET void FlushCountersSsse3(Ssse3State &state) {
+	const auto zero = _mm_setzero_si128();
+	const auto continuations = _mm_sad_epu8(state.continuations, zero);
+	const auto fourByteLeads = _mm_sad_epu8(state.fourByteLeads, zero);
+	const auto shrink = _mm_sub_epi64(continuations, fourByteLeads);
+	state.utf16Shrink += qsizetype(_mm_cvtsi128_si32(shrink))
+		+ qsizetype(_mm_cvtsi128_si32(_mm_srli_si128(shrink, 8)));
+	state.continuations = zero;
+	state.fourByteLeads = zero;
+	state.counted = 0;
+}
+
+BASE_UTF8_SSSE3_TARGET inline __m128i LoadTable(const uchar *table) {
+	return _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+}
+
+BASE_UTF8_SSSE3_TARGET void CheckBlockSsse3(
+		Ssse3State &state,
+		__m128i input) {
+	const auto high = _mm_movemask_epi8(input);
+	if (!high) {
+		state.error = _mm_or_si128(state.error, state.incomplete);
+		state.previous = input;
+		return;
+	}
+	const auto nibble = _mm_set1_epi8(0x0F);
+	const auto previous1 = _mm_alignr_epi8(input, state.previous, 15);
+	const auto special = _mm_and_si128(
+		_mm_and_si128(
+			_mm_shuffle_epi8(
+				LoadTable(kFirstHigh),
+				_mm_and_si128(_mm_srli_epi16(previous1, 4), nibble)),
+			_mm_shuffle_epi8(
+				LoadTable(kFirstLow),
+				_mm_and_si128(previous1, nibble))),
+		_mm_shuffle_epi8(
+			LoadTable(kSecondHigh),
+			_mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+	// Only 111_____ and 1111____ two and three bytes before are >= 0x80.
+	const auto third = _mm_subs_epu8(
+		_mm_alignr_epi8(input, state.previous, 14),
+		_mm_set1_epi8(char(0xE0 - 0x80)));
+	const auto fourth = _mm_subs_epu8(
+		_mm_alignr_epi8(input, state.previous, 13),
+		_mm_set1_epi8(char(0xF0 - 0x80)));
+	const auto must23 = _mm_and_si128(
+		_mm_or_si128(third, fourth),
+		_mm_set1_epi8(char(0x80)));
+	state.error = _mm_or_si128(
+		state.error,
+		_mm_xor_si128(must23, special));
+	state.incomplete = _mm_subs_epu8(input, LoadTable(kIncompleteMax));
+	state.previous = input;
+
+	// Continuations are 0x80-0xBF and four byte leads 0xF0-0xFF,
+	// each of the compare results adds one to the byte counters.
+	const auto one = _mm_set1_epi8(1);
+	state.continuations = _mm_add_epi8(
+		state.continuations,
+		_mm_and_si128(
+			_mm_cmplt_epi8(input, _mm_set1_epi8(char(0xC0))),
+			one));
+	state.fourByteLeads = _mm_add_epi8(
+		state.fourByteLeads,
+		_mm_and_si128(
+			_mm_cmpeq_epi8(
+				_mm_max_epu8(input, _mm_set1_epi8(char(0xF0))),
+				input),
+			one));
+	if (++state.counted == kFlushCountersEach) {
+		FlushCountersSsse3(state);
+	}
+}
+
+BASE_UTF8_SSSE3_TARGET Utf8Validation ValidateSsse3(
+		const uchar *from,
+		const uchar *till) {
+	const auto size = qsizetype(till - from);
+	auto state = Ssse3State();
+	for (; till - from >= kBlockSize; from += kBlockSize) {
+		CheckBlockSsse3(
+			state,
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(from)));
+	}
+
+	// Zero padding is ASCII, so it reveals a cut sequence as well.
+	uchar last[kBlockSize] = { 0 };
+	if (from != till) {
+		memcpy(last, from, till - from);
+	}
+	CheckBlockSsse3(
+		state,
+		_mm_loadu_si128(reinterpret_cast<const __m128i*>(last)));
+	const auto error = _mm_or_si128(state.error, state.incomplete);
+	const auto zero = _mm_cmpeq_epi8(error, _mm_setzero_si128());
+	if (_mm_movemask_epi8(zero) != 0xFFFF) {
+		return {};
+	}
+	FlushCountersSsse3(state);
+	return {
+		.utf16Length = size - state.utf16Shrink,
+		.valid = true,
+	};
+}
+
+#elif defined BASE_UTF8_NEON // BASE_UTF8_SSSE3
+
+struct NeonState {
+	uint8x16_t error = vdupq_n_u8(0);
+	uint8x16_t previous = vdupq_n_u8(0);
+	uint8x16_t incomplete = vdupq_n_u8(0);
+	qsizetype continuations = 0;
+	qsizetype fourByteLeads = 0;
+};
+
+void CheckBlockNeon(NeonState &state, uint8x16_t input) {
+	if (vmaxvq_u8(input) < 0x80) {
+		state.error = vorrq_u8(state.error, state.incomplete);
+		state.previous = input;
+		return;
+	}
+	const auto previous1 = vextq_u8(state.previous, input, 15);
+	const auto special = vandq_u8(
+		vandq_u8(
+			vqtbl1q_u8(vld1q_u8(kFirstHigh), vshrq_n_u8(previous1, 4)),
+			vqtbl1q_u8(
+				vld1q_u8(kFirstLow),
+				vandq_u8(previous1, vdupq_n_u8(0x0F)))),
+		vqtbl1q_u8(vld1q_u8(kSecondHigh), vshrq_n_u8(input, 4)));
+
+	// Only 111_____ and 1111____ two and three bytes before are >= 0x80.
+	const auto third = vqsubq_u8(
+		vextq_u8(state.previous, input, 14),
+		vdupq_n_u8(0xE0 - 0x80));
+	const auto fourth = vqsubq_u8(
+		vextq_u8(state.previous, input, 13),
+		vdupq_n_u8(0xF0 - 0x80));
+	const auto must23 = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+	state.error = vorrq_u8(state.error, veorq_u8(must23, special));
+	state.incomplete = vqsubq_u8(input, vld1q_u8(kIncompleteMax));
+	state.previous = input;
+
+	// Continuations are 0x80-0xBF and four byte leads 0xF0-0xFF.
+	const auto continuations = vandq_u8(
+		vandq_u8(vcgeq_u8(input, vdupq_n_u8(0x80)),
+			vcltq_u8(input, vdupq_n_u8(0xC0))),
+		vdupq_n_u8(1));
+	const auto leads = vandq_u8(
+		vcgeq_u8(input, vdupq_n_u8(0xF0)),
+		vdupq_n_u8(1));
+	state.continuations += vaddvq_u8(continuations);
+	state.fourByteLeads += vaddvq_u8(leads);
+}
+
+Utf8Validation ValidateNeon(const uchar *from, const uchar *till) {
+	const auto size = qsizetype(till - from);
+	auto state = NeonState();
+	for (; till - from >= kBlockSize; from += kBlockSize) {
+		CheckBlockNeon(state, vld1q_u8(from));
+	}
+
+	// Zero padding is ASCII, so it reveals a cut sequence as well.
+	uchar last[kBlockSize] = { 0 };
+	if (from != till) {
+		memcpy(last, from, till - from);
+	}
+	CheckBlockNeon(state, vld1q_u8(last));
+	if (vmaxvq_u8(vorrq_u8(state.error, state.incomplete)) != 0) {
+		return {};
+	}
+	return {
+		.utf16Length = size - state.continuations + state.fourByteLeads,
+		.valid = true,
+	};
+}
+
+#endif // BASE_UTF8_SSSE3 || BASE_UTF8_NEON
+
+} // namespace
+
+Utf8Validation ValidateUtf8(gsl::span<const char> bytes) {
+	const auto from = reinterpret_cast<const uchar*>(bytes.data());
+	const auto till = from + bytes.size();
+#ifdef BASE_UTF8_SSSE3
+	static const auto ssse3 = HasSsse3();
+	return ssse3 ? ValidateSsse3(from, till) : ValidateScalar(from, till);
+#elif defined BASE_UTF8_NEON // BASE_UTF8_SSSE3
+	return ValidateNeon(from, till);
+#else // BASE_UTF8_SSSE3 || BASE_UTF8_NEON
+	return ValidateScalar(from, till);
+#endif // BASE_UTF8_SSSE3 || BASE_UTF8_NEON
+}
+
+} // namespace base
@@ -0,0 +1,23 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+#include <gsl/gsl>
+
+namespace base {
+
+struct Utf8Validation {
+	qsizetype utf16Length = 0; // Only for valid input.
+	bool valid = false;
+};
+
+// Strict UTF-8: no overlong forms, surrogates or code points
+// above U+10FFFF, so exactly what QString::fromUtf8() decodes
+// without replacement characters.
+[[nodiscard]] Utf8Validation ValidateUtf8(gsl::span<const char> bytes);
+
+} // namespace base
@@ -0,0 +1,68 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include <catch.hpp>
+
+#include "base/utf8.h"
+
+#include <QtCore/QString>
+
+#include <random>
+
+namespace {
+
+[[nodiscard]] base::Utf8Validation Validate(const QByteArray &bytes) {
+	return base::ValidateUtf8({ bytes.constData(), size_t(bytes.size()) });
+}
+
+// The check FromUtf8Safe() used to do.
+[[nodiscard]] bool RoundTrips(const QByteArray &bytes) {
+	return (QString::fromUtf8(bytes).toUtf8() == bytes);
+}
+
+} // namespace
+
+TEST_CASE("utf8 validation", "[utf8]") {
+	SECTION("well formed sequences") {
+		REQUIRE(Validate("").valid);
+		REQUIRE(base::ValidateUtf8(gsl::span<const char>()).valid);
+		REQUIRE(Validate("ascii only").utf16Length == 10);
+		REQUIRE(Validate("\xD0\xB0\xE2\x82\xAC").utf16Length == 2);
+		REQUIRE(Validate("\xF0\x9F\x98\x80").utf16Length == 2);
+		REQUIRE(Validate("\xED\x9F\xBF\xF4\x8F\xBF\xBF").valid);
+	}
+	SECTION("ill formed sequences") {
+		REQUIRE(!Validate("\xC0\x80").valid); // Overlong.
+		REQUIRE(!Validate("\xE0\x9F\xBF").valid); // Overlong.
+		REQUIRE(!Validate("\xF0\x8F\xBF\xBF").valid); // Overlong.
+		REQUIRE(!Validate("\xED\xA0\x80").valid); // Surrogate.
+		REQUIRE(!Validate("\xF4\x90\x80\x80").valid); // Above U+10FFFF.
+		REQUIRE(!Validate("\x80").valid);
+		REQUIRE(!Validate("\xFF").valid);
+		REQUIRE(!Validate("cut at the end of the input\xF0\x9F\x98").valid);
+		REQUIRE(!Validate("exactly sixteen\xE2").valid);
+	}
+	SECTION("same as the round trip through QString") {
+		const char *pieces[] = {
+			"a", "bcdefghijklmnopq", "\xD0\xB0", "\xE2\x82\xAC",
+			"\xF0\x9F\x98\x80", "\xED\x9F\xBF", "\xED\xA0\x80",
+			"\xE0\x9F\xBF", "\xF4\x8F\xBF\xBF", "\xF4\x90\x80\x80",
+			"\xC0\x80", "\xC2\x80", "\x80", "\xFF", "\xE2", "\xF0\x9F",
+		};
+		auto generator = std::mt19937(47);
+		for (auto i = 0; i != 100000; ++i) {
+			auto bytes = QByteArray();
+			for (auto j = int(generator() % 24); j != 0; --j) {
+				bytes.append(pieces[generator() % std::size(pieces)]);
+			}
+			const auto result = Validate(bytes);
+			REQUIRE(result.valid == RoundTrips(bytes));
+			if (result.valid) {
+				REQUIRE(result.utf16Length == QString::fromUtf8(bytes).size());
+			}
+		}
+	}
+}
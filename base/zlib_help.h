@@ -9,8 +9,17 @@
 #include <minizip/zip.h>
 #include <minizip/unzip.h>
 
+#include "base/bytes.h"
 #include "logs.h"
 
+#include <QtCore/QFile>
+#include <crl/crl_async.h>
+#include <crl/crl_semaphore.h>
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
 #ifdef small
 #undef small
 #endif // small
@@ -18,24 +27,58 @@
 namespace zlib {
 namespace internal {
 
-class InMemoryFile {
+template <typename Source>
+class FileFuncs {
 public:
-	InMemoryFile(const QByteArray &data = QByteArray()) : _data(data) {
-	}
-
 	zlib_filefunc_def funcs() {
 		zlib_filefunc_def result;
-		result.opaque = this;
-		result.zopen_file = &InMemoryFile::Open;
-		result.zerror_file = &InMemoryFile::Error;
-		result.zread_file = &InMemoryFile::Read;
-		result.zwrite_file = &InMemoryFile::Write;
-		result.zclose_file = &InMemoryFile::Close;
-		result.zseek_file = &InMemoryFile::Seek;
-		result.ztell_file = &InMemoryFile::Tell;
+		result.opaque = static_cast<Source*>(this);
+		result.zopen_file = &FileFuncs::Open;
+		result.zerror_file = &FileFuncs::Error;
+		result.zread_file = &FileFuncs::Read;
+		result.zwrite_file = &FileFuncs::Write;
+		result.zclose_file = &FileFuncs::Close;
+		result.zseek_file = &FileFuncs::Seek;
+		result.ztell_file = &FileFuncs::Tell;
 		return result;
 	}
 
+private:
+	static voidpf Open(voidpf opaque, const char* filename, int mode) {
+		return static_cast<Source*>(opaque)->open(filename, mode);
+	}
+
+	static uLong Read(voidpf opaque, voidpf stream, void* buf, uLong size) {
+		return static_cast<Source*>(opaque)->read(stream, buf, size);
+	}
+
+	static uLong Write(voidpf opaque, voidpf stream, const void* buf, uLong size) {
+		return static_cast<Source*>(opaque)->write(stream, buf, size);
+	}
+
+	static int Close(voidpf opaque, voidpf stream) {
+		return static_cast<Source*>(opaque)->close(stream);
+	}
+
+	static int Error(voidpf opaque, voidpf stream) {
+		return static_cast<Source*>(opaque)->error(stream);
+	}
+
+	static long Tell(voidpf opaque, voidpf stream) {
+		return static_cast<Source*>(opaque)->tell(stream);
+	}
+
+	static long Seek(voidpf opaque, voidpf stream, uLong offset, int origin) {
+		return static_cast<Source*>(opaque)->seek(stream, offset, origin);
+	}
+
+};
+
+class InMemoryFile final : public FileFuncs<InMemoryFile> {
+public:
+	InMemoryFile(const QByteArray &data = QByteArray()) : _data(data) {
+	}
+
 	int error() const {
 		return _error;
 	}
@@ -45,6 +88,8 @@ public:
 	}
 
 private:
+	friend class FileFuncs<InMemoryFile>;
+
 	voidpf open(const char *filename, int mode) {
 		if (mode & ZLIB_FILEFUNC_MODE_WRITE) {
 			if (mode & ZLIB_FILEFUNC_MODE_CREATE) {
@@ -109,54 +154,379 @@ private:
 		return _error;
 	}
 
-	static voidpf Open(voidpf opaque, const char* filename, int mode) {
-		return static_cast<InMemoryFile*>(opaque)->open(filename, mode);
+	uLong _position = 0;
+	int _error = 0;
+	QByteArray _data;
+
+};
+
+// Read-only mapping of a file on disk, may be shared between readers.
+class MappedData final {
+public:
+	explicit MappedData(const QString &path) : _file(path) {
+		if (_file.open(QIODevice::ReadOnly)) {
+			const auto size = _file.size();
+			if (size > 0 && size <= std::numeric_limits<uLong>::max()) {
+				if (const auto data = _file.map(0, size)) {
+					_data = bytes::make_span(data, size);
+				}
+			}
+		}
 	}
+	MappedData(const MappedData &other) = delete;
+	MappedData &operator=(const MappedData &other) = delete;
 
-	static uLong Read(voidpf opaque, voidpf stream, void* buf, uLong size) {
-		return static_cast<InMemoryFile*>(opaque)->read(stream, buf, size);
+	[[nodiscard]] bool valid() const {
+		return !_data.empty();
+	}
+	[[nodiscard]] bytes::const_span data() const {
+		return _data;
 	}
 
-	static uLong Write(voidpf opaque, voidpf stream, const void* buf, uLong size) {
-		return static_cast<InMemoryFile*>(opaque)->write(stream, buf, size);
+private:
+	QFile _file;
+	bytes::const_span _data;
+
+};
+
+class MappedFile final : public FileFuncs<MappedFile> {
+public:
+	explicit MappedFile(std::shared_ptr<const MappedData> data)
+	: _data(std::move(data))
+	, _error(_data->valid() ? 0 : -1) {
 	}
 
-	static int Close(voidpf opaque, voidpf stream) {
-		return static_cast<InMemoryFile*>(opaque)->close(stream);
+	int error() const {
+		return _error;
 	}
 
-	static int Error(voidpf opaque, voidpf stream) {
-		return static_cast<InMemoryFile*>(opaque)->error(stream);
+	[[nodiscard]] const std::shared_ptr<const MappedData> &data() const {
+		return _data;
 	}
 
-	static long Tell(voidpf opaque, voidpf stream) {
-		return static_cast<InMemoryFile*>(opaque)->tell(stream);
+private:
+	friend class FileFuncs<MappedFile>;
+
+	[[nodiscard]] uLong size() const {
+		return uLong(_data->data().size());
 	}
 
-	static long Seek(voidpf opaque, voidpf stream, uLong offset, int origin) {
-		return static_cast<InMemoryFile*>(opaque)->seek(stream, offset, origin);
+	voidpf open(const char *filename, int mode) {
+		if (mode & ZLIB_FILEFUNC_MODE_WRITE) {
+			_error = -1;
+			return nullptr;
+		}
+		_position = 0;
+		_error = _data->valid() ? 0 : -1;
+		return this;
+	}
+
+	uLong read(voidpf stream, void* buf, uLong size) {
+		uLong toRead = 0;
+		if (!_error && this->size() > _position) {
+			toRead = std::min(size, this->size() - _position);
+			memcpy(buf, _data->data().data() + _position, toRead);
+			_position += toRead;
+		}
+		return toRead;
+	}
+
+	uLong write(voidpf stream, const void* buf, uLong size) {
+		_error = -1;
+		return 0;
+	}
+
+	int close(voidpf stream) {
+		auto result = _error;
+		_position = 0;
+		_error = 0;
+		return result;
+	}
+
+	int error(voidpf stream) const {
+		return _error;
+	}
+
+	long tell(voidpf stream) const {
+		return _position;
+	}
+
+	long seek(voidpf stream, uLong offset, int origin) {
+		if (!_error) {
+			switch (origin) {
+			case ZLIB_FILEFUNC_SEEK_SET: _position = offset; break;
+			case ZLIB_FILEFUNC_SEEK_CUR: _position += offset; break;
+			case ZLIB_FILEFUNC_SEEK_END: _position = size() + offset; break;
+			}
+			if (_position > size()) {
+				_error = -1;
+			}
+		}
+		return _error;
 	}
 
+	std::shared_ptr<const MappedData> _data;
 	uLong _position = 0;
 	int _error = 0;
-	QByteArray _data;
 
 };
 
-} // namespace internal
+// Write target that grows by geometrically increasing chunks,
+// so that written data is never moved until the final result().
+class ChunkedFile final : public FileFuncs<ChunkedFile> {
+public:
+	int error() const {
+		return _error;
+	}
 
-constexpr int kCaseSensitive = 1;
-constexpr int kCaseInsensitive = 2;
+	QByteArray result() const {
+		auto result = QByteArray();
+		result.reserve(int(_size));
+		auto left = _size;
+		for (const auto &chunk : _chunks) {
+			const auto size = std::min(left, uLong(chunk.size()));
+			result.append(reinterpret_cast<const char*>(chunk.data()), size);
+			left -= size;
+		}
+		return result;
+	}
+
+private:
+	friend class FileFuncs<ChunkedFile>;
+
+	static constexpr auto kFirstChunk = uLong(64 * 1024);
+	static constexpr auto kMaxChunk = uLong(16 * 1024 * 1024);
+
+	voidpf open(const char *filename, int mode) {
+		if (mode & ZLIB_FILEFUNC_MODE_WRITE) {
+			if (mode & ZLIB_FILEFUNC_MODE_CREATE) {
+				_chunks.clear();
+				_capacity = _size = 0;
+			}
+			_position = _size;
+		} else if (mode & ZLIB_FILEFUNC_MODE_READ) {
+			_position = 0;
+		}
+		_error = 0;
+		return this;
+	}
+
+	template <typename Method>
+	void enumerate(uLong position, uLong size, Method &&method) {
+		auto offset = uLong(0);
+		for (auto &chunk : _chunks) {
+			const auto chunkSize = uLong(chunk.size());
+			if (!size) {
+				break;
+			} else if (position < offset + chunkSize) {
+				const auto from = position - offset;
+				const auto count = std::min(size, chunkSize - from);
+				method(chunk.data() + from, count);
+				position += count;
+				size -= count;
+			}
+			offset += chunkSize;
+		}
+	}
+
+	uLong read(voidpf stream, void* buf, uLong size) {
+		uLong toRead = 0;
+		if (!_error && _size > _position) {
+			toRead = std::min(size, _size - _position);
+			auto to = static_cast<char*>(buf);
+			enumerate(_position, toRead, [&](bytes::type *data, uLong count) {
+				memcpy(to, data, count);
+				to += count;
+			});
+			_position += toRead;
+		}
+		return toRead;
+	}
+
+	uLong write(voidpf stream, const void* buf, uLong size) {
+		if (_error) {
+			return 0;
+		}
+		while (_capacity < _position + size) {
+			const auto chunk = _chunks.empty()
+				? kFirstChunk
+				: std::min(uLong(_chunks.back().size()) * 2, kMaxChunk);
+			_chunks.emplace_back(chunk);
+			_capacity += chunk;
+		}
+		auto from = static_cast<const char*>(buf);
+		enumerate(_position, size, [&](bytes::type *data, uLong count) {
+			memcpy(data, from, count);
+			from += count;
+		});
+		_position += size;
+		_size = std::max(_size, _position);
+		return size;
+	}
+
+	int close(voidpf stream) {
+		auto result = _error;
+		_position = 0;
+		_error = 0;
+		return result;
+	}
+
+	int error(voidpf stream) const {
+		return _error;
+	}
+
+	long tell(voidpf stream) const {
+		return _position;
+	}
+
+	long seek(voidpf stream, uLong offset, int origin) {
+		if (!_error) {
+			switch (origin) {
+			case ZLIB_FILEFUNC_SEEK_SET: _position = offset; break;
+			case ZLIB_FILEFUNC_SEEK_CUR: _position += offset; break;
+			case ZLIB_FILEFUNC_SEEK_END: _position = _size + offset; break;
+			}
+			if (_position > _size) {
+				_error = -1;
+			}
+		}
+		return _error;
+	}
+
+	std::vector<bytes::vector> _chunks;
+	uLong _capacity = 0;
+	uLong _size = 0;
+	uLong _position = 0;
+	int _error = 0;
+
+};
 
-class FileToRead {
+// Write target that streams the archive right to a file on disk.
+class DiskFile final : public FileFuncs<DiskFile> {
 public:
-	FileToRead(const QByteArray &content) : _data(content) {
-		auto funcs = _data.funcs();
-		if (!(_handle = unzOpen2(nullptr, &funcs))) {
+	explicit DiskFile(const QString &path) : _file(path) {
+		_error = _file.open(QIODevice::WriteOnly) ? 0 : -1;
+	}
+	explicit DiskFile(int descriptor) {
+		_error = _file.open(descriptor, QIODevice::WriteOnly) ? 0 : -1;
+	}
+
+	int error() const {
+		return _error;
+	}
+
+private:
+	friend class FileFuncs<DiskFile>;
+
+	voidpf open(const char *filename, int mode) {
+		if (!(mode & ZLIB_FILEFUNC_MODE_WRITE)) {
+			_error = -1;
+		}
+		return _error ? nullptr : this;
+	}
+
+	uLong read(voidpf stream, void* buf, uLong size) {
+		_error = -1;
+		return 0;
+	}
+
+	uLong write(voidpf stream, const void* buf, uLong size) {
+		if (_error) {
+			return 0;
+		}
+		const auto written = _file.write(static_cast<const char*>(buf), size);
+		if (written != qint64(size)) {
+			_error = -1;
+			return 0;
+		}
+		return size;
+	}
+
+	int close(voidpf stream) {
+		if (!_error && !_file.flush()) {
 			_error = -1;
 		}
+		return _error;
+	}
+
+	int error(voidpf stream) const {
+		return _error;
+	}
+
+	long tell(voidpf stream) const {
+		return long(_file.pos());
+	}
+
+	long seek(voidpf stream, uLong offset, int origin) {
+		if (!_error) {
+			auto position = qint64();
+			switch (origin) {
+			case ZLIB_FILEFUNC_SEEK_SET: position = offset; break;
+			case ZLIB_FILEFUNC_SEEK_CUR: position = _file.pos() + offset; break;
+			case ZLIB_FILEFUNC_SEEK_END: position = _file.size() + offset; break;
+			}
+			if (!_file.seek(position)) {
+				_error = -1;
+			}
+		}
+		return _error;
 	}
 
+	QFile _file;
+	int _error = 0;
+
+};
+
+// Runs method(index) for each index in [0, count) on the crl::async()
+// pool and waits for all of them. Must not be called from that pool.
+inline void ParallelFor(int count, Fn<void(int)> method) {
+	if (count <= 0) {
+		return;
+	} else if (count == 1) {
+		method(0);
+		return;
+	}
+	struct State {
+		Fn<void(int)> method;
+		std::atomic<int> next = 0;
+		std::atomic<int> running = 0;
+		crl::semaphore done;
+	};
+	const auto state = std::make_shared<State>();
+	const auto workers = std::clamp(
+		int(std::thread::hardware_concurrency()),
+		1,
+		count);
+	state->method = std::move(method);
+	state->running = workers;
+	for (auto i = 0; i != workers; ++i) {
+		crl::async([=] {
+			for (auto index = state->next++
+				; index < count
+				; index = state->next++) {
+				state->method(index);
+			}
+			if (!--state->running) {
+				state->done.release();
+			}
+		});
+	}
+	state->done.acquire();
+}
+
+} // namespace internal
+
+constexpr int kCaseSensitive = 1;
+constexpr int kCaseInsensitive = 2;
+
+namespace internal {
+
+template <typename Source>
+class ReaderBase {
+public:
+	ReaderBase(const ReaderBase &other) = delete;
+	ReaderBase &operator=(const ReaderBase &other) = delete;
+
 	int getGlobalInfo(unz_global_info *pglobal_info) {
 		if (error() == UNZ_OK) {
 			_error = _handle ? unzGetGlobalInfo(_handle, pglobal_info) : -1;
@@ -166,7 +536,11 @@ public:
 
 	int locateFile(const char *szFileName, int iCaseSensitivity) {
 		if (error() == UNZ_OK) {
-			_error = _handle ? unzLocateFile(_handle, szFileName, iCaseSensitivity) : -1;
+			_error = !_handle
+				? -1
+				: _index
+				? locateIndexed(szFileName, iCaseSensitivity)
+				: unzLocateFile(_handle, szFileName, iCaseSensitivity);
 		}
 		return error();
 	}
@@ -185,6 +559,13 @@ public:
 		return error();
 	}
 
+	int goToFilePos(unz_file_pos position) {
+		if (error() == UNZ_OK) {
+			_error = _handle ? unzGoToFilePos(_handle, &position) : -1;
+		}
+		return error();
+	}
+
 	int getCurrentFileInfo(
 			unz_file_info *pfile_info,
 			char *szFileName,
@@ -242,6 +623,23 @@ public:
 		return error();
 	}
 
+	int64 readCurrentFile(bytes::span buffer) {
+		auto result = int64();
+		while (!buffer.empty()) {
+			constexpr auto kChunk = std::size_t(1) << 30;
+			const auto chunk = std::min(buffer.size(), kChunk);
+			const auto read = readCurrentFile(buffer.data(), unsigned(chunk));
+			if (read < 0) {
+				return read;
+			} else if (!read) {
+				break;
+			}
+			result += read;
+			buffer = buffer.subspan(read);
+		}
+		return result;
+	}
+
 	int closeCurrentFile() {
 		if (error() == UNZ_OK) {
 			_error = _handle ? unzCloseCurrentFile(_handle) : -1;
@@ -249,38 +647,51 @@ public:
 		return error();
 	}
 
-	QByteArray readCurrentFileContent(int fileSizeLimit) {
+	[[nodiscard]] int64 currentFileSize() {
 		unz_file_info fileInfo = { 0 };
 		if (getCurrentFileInfo(&fileInfo, nullptr, 0, nullptr, 0, nullptr, 0) != UNZ_OK) {
 			LOG(("Error: could not get current file info in a zip file."));
-			return QByteArray();
+			return -1;
 		}
+		return int64(fileInfo.uncompressed_size);
+	}
 
-		auto size = fileInfo.uncompressed_size;
-		if (size > static_cast<uint32>(fileSizeLimit)) {
-			if (_error == UNZ_OK) _error = -1;
-			LOG(("Error: current file is too large (should be less than %1, got %2) in a zip file.").arg(fileSizeLimit).arg(size));
-			return QByteArray();
-		}
+	// Inflates the current file right into the buffer,
+	// its size must be exactly the currentFileSize().
+	bool readCurrentFileContent(bytes::span buffer) {
 		if (openCurrentFile() != UNZ_OK) {
 			LOG(("Error: could not open current file in a zip file."));
-			return QByteArray();
+			return false;
 		}
 
-		QByteArray result;
-		result.resize(size);
-
-		auto couldRead = readCurrentFile(result.data(), size);
-		if (couldRead != static_cast<int>(size)) {
+		const auto couldRead = readCurrentFile(buffer);
+		if (couldRead != static_cast<int64>(buffer.size())) {
 			LOG(("Error: could not read current file in a zip file, got %1.").arg(couldRead));
-			return QByteArray();
+			return false;
 		}
 
 		if (closeCurrentFile() != UNZ_OK) {
 			LOG(("Error: could not close current file in a zip file."));
+			return false;
+		}
+		return true;
+	}
+
+	QByteArray readCurrentFileContent(int fileSizeLimit) {
+		const auto size = currentFileSize();
+		if (size < 0) {
+			return QByteArray();
+		} else if (size > static_cast<uint32>(fileSizeLimit)) {
+			if (_error == UNZ_OK) _error = -1;
+			LOG(("Error: current file is too large (should be less than %1, got %2) in a zip file.").arg(fileSizeLimit).arg(size));
 			return QByteArray();
 		}
 
+		QByteArray result;
+		result.resize(int(size));
+		if (!readCurrentFileContent(bytes::make_detached_span(result))) {
+			return QByteArray();
+		}
 		return result;
 	}
 
@@ -292,6 +703,14 @@ public:
 		return readCurrentFileContent(fileSizeLimit);
 	}
 
+	bool readFileContent(const char *szFileName, int iCaseSensitivity, bytes::span buffer) {
+		if (locateFile(szFileName, iCaseSensitivity) != UNZ_OK) {
+			LOG(("Error: could not locate '%1' in a zip file.").arg(szFileName));
+			return false;
+		}
+		return readCurrentFileContent(buffer);
+	}
+
 	void close() {
 		if (_handle && unzClose(_handle) != UNZ_OK && _error == UNZ_OK) {
 			_error = -1;
@@ -310,26 +729,316 @@ public:
 		_error = UNZ_OK;
 	}
 
-	~FileToRead() {
+	~ReaderBase() {
 		close();
 	}
 
+protected:
+	template <typename ...Args>
+	explicit ReaderBase(Args &&...args) : _data(std::forward<Args>(args)...) {
+		auto funcs = _data.funcs();
+		if (!(_handle = unzOpen2(nullptr, &funcs))) {
+			_error = -1;
+		}
+	}
+
+	// Walks the central directory once, so that locateFile() is O(1).
+	void buildIndex() {
+		if (!_handle || error() != UNZ_OK) {
+			return;
+		}
+		auto index = std::make_unique<Index>();
+		auto name = std::string();
+		for (auto result = unzGoToFirstFile(_handle)
+			; result == UNZ_OK
+			; result = unzGoToNextFile(_handle)) {
+			unz_file_info info = { 0 };
+			if (unzGetCurrentFileInfo(_handle, &info, nullptr, 0, nullptr, 0, nullptr, 0) != UNZ_OK) {
+				return;
+			}
+			name.resize(info.size_filename);
+			if (unzGetCurrentFileInfo(_handle, nullptr, name.data(), uLong(name.size()), nullptr, 0, nullptr, 0) != UNZ_OK) {
+				return;
+			}
+			auto position = unz_file_pos();
+			if (unzGetFilePos(_handle, &position) != UNZ_OK) {
+				return;
+			}
+			// Keep the first entry with a given name, like unzLocateFile.
+			index->sensitive.emplace(name, position);
+			index->insensitive.emplace(LowerAscii(name), position);
+			index->files.push_back({
+				.name = name,
+				.position = position,
+				.size = info.uncompressed_size,
+			});
+		}
+		unzGoToFirstFile(_handle);
+		_index = std::move(index);
+	}
+
+	struct IndexedFile {
+		std::string name;
+		unz_file_pos position;
+		uLong size = 0;
+	};
+
+	[[nodiscard]] const Source &source() const {
+		return _data;
+	}
+
+	[[nodiscard]] const std::vector<IndexedFile> *indexedFiles() const {
+		return _index ? &_index->files : nullptr;
+	}
+
 private:
-	internal::InMemoryFile _data;
+	struct Index {
+		std::unordered_map<std::string, unz_file_pos> sensitive;
+		std::unordered_map<std::string, unz_file_pos> insensitive;
+		std::vector<IndexedFile> files;
+	};
+
+	[[nodiscard]] static std::string LowerAscii(std::string value) {
+		for (auto &ch : value) {
+			if (ch >= 'A' && ch <= 'Z') {
+				ch = ch - 'A' + 'a';
+			}
+		}
+		return value;
+	}
+
+	[[nodiscard]] int locateIndexed(const char *szFileName, int iCaseSensitivity) {
+		const auto insensitive = (iCaseSensitivity == kCaseInsensitive);
+		if (!insensitive && iCaseSensitivity != kCaseSensitive) {
+			return unzLocateFile(_handle, szFileName, iCaseSensitivity);
+		}
+		const auto &map = insensitive ? _index->insensitive : _index->sensitive;
+		const auto i = map.find(insensitive
+			? LowerAscii(szFileName)
+			: std::string(szFileName));
+		if (i == end(map)) {
+			return UNZ_END_OF_LIST_OF_FILE;
+		}
+		auto position = i->second;
+		return unzGoToFilePos(_handle, &position);
+	}
+
+	Source _data;
 	unzFile _handle = nullptr;
+	std::unique_ptr<Index> _index;
 	int _error = 0;
 
 };
 
-class FileToWrite {
+} // namespace internal
+
+class FileToRead final : public internal::ReaderBase<internal::InMemoryFile> {
 public:
-	FileToWrite() {
-		auto funcs = _data.funcs();
-		if (!(_handle = zipOpen2(nullptr, APPEND_STATUS_CREATE, nullptr, &funcs))) {
-			_error = -1;
+	FileToRead(const QByteArray &content) : ReaderBase(content) {
+	}
+
+};
+
+// Reads the archive through a read-only mapping of the file on disk
+// instead of loading it into memory, locates entries by name in O(1).
+class MappedFileToRead final
+	: public internal::ReaderBase<internal::MappedFile> {
+public:
+	explicit MappedFileToRead(const QString &path)
+	: MappedFileToRead(std::make_shared<internal::MappedData>(path)) {
+	}
+	explicit MappedFileToRead(std::shared_ptr<const internal::MappedData> data)
+	: ReaderBase(std::move(data)) {
+		buildIndex();
+	}
+
+	[[nodiscard]] const std::shared_ptr<const internal::MappedData> &data() const {
+		return source().data();
+	}
+
+	struct UnpackedFile {
+		QString name;
+		QByteArray content;
+	};
+
+	// Inflates all the files accepted by the filter on the crl::async()
+	// pool, each worker reads the shared mapping through its own handle.
+	[[nodiscard]] std::optional<std::vector<UnpackedFile>> readFilesContent(
+			int fileSizeLimit,
+			int64 totalSizeLimit,
+			Fn<bool(const QString &name)> filter = nullptr) {
+		const auto files = indexedFiles();
+		if (!files || error() != UNZ_OK) {
+			LOG(("Error: could not read the central directory of a zip file."));
+			return std::nullopt;
+		}
+		auto result = std::vector<UnpackedFile>();
+		auto positions = std::vector<unz_file_pos>();
+		auto total = int64();
+		for (const auto &file : *files) {
+			auto name = QString::fromStdString(file.name);
+			if (filter && !filter(name)) {
+				continue;
+			} else if (file.size > static_cast<uint32>(fileSizeLimit)) {
+				LOG(("Error: file '%1' is too large (should be less than %2, got %3) in a zip file.").arg(name).arg(fileSizeLimit).arg(file.size));
+				return std::nullopt;
+			}
+			total += file.size;
+			if (total > totalSizeLimit) {
+				LOG(("Error: files are too large (should be less than %1 in total) in a zip file.").arg(totalSizeLimit));
+				return std::nullopt;
+			}
+			result.push_back({
+				.name = std::move(name),
+				.content = QByteArray(int(file.size), Qt::Uninitialized),
+			});
+			positions.push_back(file.position);
+		}
+		if (result.empty()) {
+			return result;
 		}
+
+		const auto count = int(result.size());
+		const auto workers = std::clamp(
+			int(std::thread::hardware_concurrency()),
+			1,
+			count);
+		auto failed = std::atomic<bool>(false);
+		internal::ParallelFor(workers, [&](int worker) {
+			auto reader = Worker(data());
+			for (auto i = worker; i < count && !failed; i += workers) {
+				auto &file = result[i];
+				if (reader.goToFilePos(positions[i]) != UNZ_OK
+					|| !reader.readCurrentFileContent(
+						bytes::make_detached_span(file.content))) {
+					LOG(("Error: could not read '%1' in a zip file.").arg(file.name));
+					failed = true;
+				}
+			}
+		});
+		if (failed) {
+			return std::nullopt;
+		}
+		return result;
 	}
 
+private:
+	class Worker final : public internal::ReaderBase<internal::MappedFile> {
+	public:
+		explicit Worker(std::shared_ptr<const internal::MappedData> data)
+		: ReaderBase(std::move(data)) {
+		}
+
+	};
+
+};
+
+struct FileToPrepare {
+	std::string name;
+	zip_fileinfo info = { { 0 } };
+	bytes::const_span content;
+	int level = Z_DEFAULT_COMPRESSION;
+};
+
+// Entry compressed ahead of time, written to the archive as is.
+struct PreparedFile {
+	std::string name;
+	zip_fileinfo info = { { 0 } };
+	int method = 0;
+	int level = 0;
+	bytes::vector compressed;
+	bytes::const_span stored;
+	uLong uncompressedSize = 0;
+	uLong crc = 0;
+	bool valid = false;
+
+	[[nodiscard]] bytes::const_span data() const {
+		return method ? bytes::make_span(compressed) : stored;
+	}
+};
+
+[[nodiscard]] inline uLong Crc32(bytes::const_span content) {
+	auto result = crc32(0L, Z_NULL, 0);
+	while (!content.empty()) {
+		constexpr auto kChunk = std::size_t(1) << 30;
+		const auto chunk = std::min(content.size(), kChunk);
+		result = crc32(
+			result,
+			reinterpret_cast<const Bytef*>(content.data()),
+			uInt(chunk));
+		content = content.subspan(chunk);
+	}
+	return result;
+}
+
+// Computes raw deflate data and crc for the entry, keeps it stored
+// if the level is zero or if the compression doesn't help.
+[[nodiscard]] inline PreparedFile PrepareFile(const FileToPrepare &file) {
+	auto result = PreparedFile{
+		.name = file.name,
+		.info = file.info,
+		.stored = file.content,
+		.uncompressedSize = uLong(file.content.size()),
+		.crc = Crc32(file.content),
+	};
+	if (file.content.size() > std::numeric_limits<uInt>::max()) {
+		return result;
+	} else if (!file.level || file.content.empty()) {
+		result.valid = true;
+		return result;
+	}
+	auto stream = z_stream();
+	const auto init = deflateInit2(
+		&stream,
+		file.level,
+		Z_DEFLATED,
+		-MAX_WBITS,
+		8,
+		Z_DEFAULT_STRATEGY);
+	if (init != Z_OK) {
+		return result;
+	}
+	result.compressed.resize(deflateBound(&stream, uLong(file.content.size())));
+	stream.next_in = reinterpret_cast<Bytef*>(
+		const_cast<bytes::type*>(file.content.data()));
+	stream.avail_in = uInt(file.content.size());
+	stream.next_out = reinterpret_cast<Bytef*>(result.compressed.data());
+	stream.avail_out = uInt(result.compressed.size());
+	const auto deflated = deflate(&stream, Z_FINISH);
+	const auto size = stream.total_out;
+	deflateEnd(&stream);
+	if (deflated != Z_STREAM_END) {
+		return result;
+	} else if (size < result.uncompressedSize) {
+		result.compressed.resize(size);
+		result.method = Z_DEFLATED;
+		result.level = file.level;
+	} else {
+		result.compressed = bytes::vector();
+	}
+	result.valid = true;
+	return result;
+}
+
+// Compresses all entries concurrently, they should be written
+// to the archive afterwards by writePreparedFile() in order.
+[[nodiscard]] inline std::vector<PreparedFile> PrepareFiles(
+		const std::vector<FileToPrepare> &files) {
+	auto result = std::vector<PreparedFile>(files.size());
+	internal::ParallelFor(int(files.size()), [&](int index) {
+		result[index] = PrepareFile(files[index]);
+	});
+	return result;
+}
+
+namespace internal {
+
+template <typename Sink>
+class WriterBase {
+public:
+	WriterBase(const WriterBase &other) = delete;
+	WriterBase &operator=(const WriterBase &other) = delete;
+
 	int openNewFile(
 		const char *filename,
 		const zip_fileinfo *zipfi,
@@ -372,6 +1081,70 @@ public:
 		return error();
 	}
 
+	// Writes already compressed (or stored) data without recompression.
+	int writeRawFile(
+			const char *filename,
+			const zip_fileinfo *zipfi,
+			int method,
+			int level,
+			bytes::const_span data,
+			uLong uncompressedSize,
+			uLong crc) {
+		if (error() == ZIP_OK) {
+			_error = _handle ? zipOpenNewFileInZip2(
+				_handle,
+				filename,
+				zipfi,
+				nullptr,
+				0,
+				nullptr,
+				0,
+				nullptr,
+				method,
+				level,
+				1) : -1;
+		}
+		while (error() == ZIP_OK && !data.empty()) {
+			constexpr auto kChunk = std::size_t(1) << 30;
+			const auto chunk = std::min(data.size(), kChunk);
+			writeInFile(data.data(), unsigned(chunk));
+			data = data.subspan(chunk);
+		}
+		if (error() == ZIP_OK) {
+			_error = zipCloseFileInZipRaw(_handle, uncompressedSize, crc);
+		}
+		return error();
+	}
+
+	int writeStoredFile(
+			const char *filename,
+			const zip_fileinfo *zipfi,
+			bytes::const_span content) {
+		return writeRawFile(
+			filename,
+			zipfi,
+			0,
+			0,
+			content,
+			uLong(content.size()),
+			Crc32(content));
+	}
+
+	int writePreparedFile(const PreparedFile &file) {
+		if (!file.valid) {
+			if (_error == ZIP_OK) _error = -1;
+			return error();
+		}
+		return writeRawFile(
+			file.name.c_str(),
+			&file.info,
+			file.method,
+			file.level,
+			file.data(),
+			file.uncompressedSize,
+			file.crc);
+	}
+
 	void close() {
 		if (_handle && zipClose(_handle, nullptr) != ZIP_OK && _error == ZIP_OK) {
 			_error = -1;
@@ -386,19 +1159,62 @@ public:
 		return _error;
 	}
 
-	QByteArray result() const {
-		return _data.result();
+	~WriterBase() {
+		close();
 	}
 
-	~FileToWrite() {
-		close();
+protected:
+	template <typename ...Args>
+	explicit WriterBase(Args &&...args) : _data(std::forward<Args>(args)...) {
+		auto funcs = _data.funcs();
+		if (!(_handle = zipOpen2(nullptr, APPEND_STATUS_CREATE, nullptr, &funcs))) {
+			_error = -1;
+		}
+	}
+
+	[[nodiscard]] const Sink &sink() const {
+		return _data;
 	}
 
 private:
-	internal::InMemoryFile _data;
+	Sink _data;
 	zipFile _handle = nullptr;
 	int _error = 0;
 
 };
 
+} // namespace internal
+
+class FileToWrite final : public internal::WriterBase<internal::InMemoryFile> {
+public:
+	FileToWrite() = default;
+
+	QByteArray result() const {
+		return sink().result();
+	}
+
+};
+
+// Keeps the archive in a list of chunks instead of one growing buffer.
+class ChunkedFileToWrite final
+	: public internal::WriterBase<internal::ChunkedFile> {
+public:
+	ChunkedFileToWrite() = default;
+
+	QByteArray result() const {
+		return sink().result();
+	}
+
+};
+
+// Streams the archive to the disk, the descriptor is not closed.
+class DiskFileToWrite final : public internal::WriterBase<internal::DiskFile> {
+public:
+	explicit DiskFileToWrite(const QString &path) : WriterBase(path) {
+	}
+	explicit DiskFileToWrite(int descriptor) : WriterBase(descriptor) {
+	}
+
+};
+
 } // namespace zlib